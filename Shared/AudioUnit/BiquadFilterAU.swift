@@ -26,7 +26,7 @@ public class BiquadFilterAU: AUAudioUnit {
     lazy private var inputBusArray: AUAudioUnitBusArray = {
         AUAudioUnitBusArray(audioUnit: self,
                             busType: .input,
-                            busses: [kernelAdapter.inputBus])
+                            busses: [kernelAdapter.inputBus, kernelAdapter.sidechainBus])
     }()
 
     lazy private var outputBusArray: AUAudioUnitBusArray = {
@@ -38,6 +38,26 @@ public class BiquadFilterAU: AUAudioUnit {
     // The owning view controller.
     weak var viewController: BiquadFilterViewController?
 
+    // Reads the kernel's metering tap. The tap stays off until this is started.
+    lazy var spectrumAnalyzer: SpectrumAnalyzer = {
+        SpectrumAnalyzer(kernelAdapter: kernelAdapter)
+    }()
+
+    // Computes and caches response curves for the editor off the main thread.
+    lazy var responseCurveWorker: ResponseCurveWorker = {
+        let adapter = kernelAdapter
+        return ResponseCurveWorker { key in
+            adapter.coefficients(forCutoff: key.cutoff,
+                                 resonance: key.resonance,
+                                 filterType: key.filterType,
+                                 sampleRate: key.sampleRate)
+        }
+    }()
+
+    var sampleRate: Double {
+        return kernelAdapter.outputBus.format.sampleRate
+    }
+
     /// The filter's input busses.
     public override var inputBusses: AUAudioUnitBusArray {
         return inputBusArray
@@ -69,6 +89,27 @@ public class BiquadFilterAU: AUAudioUnit {
     ]
 
     private var _currentPreset: AUAudioUnitPreset?
+
+    private let controllerMapKey = "controllerMap"
+
+    // Publishes the parameters MIDI controllers move while render resources are allocated.
+    // Anything moved after the last tick is published once they're allocated again.
+    private var controllerChangeTimer: DispatchSourceTimer?
+
+    /// The parameter values, plus the MIDI controller map.
+    public override var fullState: [String: Any]? {
+        get {
+            var state = super.fullState ?? [:]
+            state[controllerMapKey] = kernelAdapter.controllerMap
+            return state
+        }
+        set {
+            super.fullState = newValue
+            if let controllerMap = newValue?[controllerMapKey] as? [NSNumber] {
+                kernelAdapter.controllerMap = controllerMap
+            }
+        }
+    }
     
     /// The currently selected preset.
     public override var currentPreset: AUAudioUnitPreset? {
@@ -161,6 +202,121 @@ public class BiquadFilterAU: AUAudioUnit {
         }
     }
 	
+    // Worker threads that share channels with the render thread; 0 renders
+    // serially. Only worth it for very wide formats. Takes effect when render
+    // resources are next allocated.
+    public var renderWorkerCount: Int {
+        get {
+            return kernelAdapter.renderWorkerCount
+        }
+        set {
+            if !renderResourcesAllocated {
+                kernelAdapter.renderWorkerCount = newValue
+            }
+        }
+    }
+	
+    // The instruction set the filter loops use, e.g. "avx2" or "neon".
+    public var kernelVariant: String {
+        return kernelAdapter.kernelVariant
+    }
+
+    public var supportedKernelVariants: [String] {
+        return kernelAdapter.supportedKernelVariants
+    }
+
+    // Forces one of `supportedKernelVariants`; nil chooses by CPU detection,
+    // or by timing each variant when `calibratesKernelVariant` is set. Takes
+    // effect when render resources are next allocated.
+    public var kernelVariantOverride: String? {
+        get {
+            return kernelAdapter.kernelVariantOverride
+        }
+        set {
+            if !renderResourcesAllocated {
+                kernelAdapter.kernelVariantOverride = newValue
+            }
+        }
+    }
+
+    public var calibratesKernelVariant: Bool {
+        get {
+            return kernelAdapter.calibratesKernelVariant
+        }
+        set {
+            if !renderResourcesAllocated {
+                kernelAdapter.calibratesKernelVariant = newValue
+            }
+        }
+    }
+
+    // How the Direct Form topology trades accuracy for speed; automatic
+    // moves to error feedback at low cutoffs. Can be changed while running.
+    // Set through the parameter tree, so observers and saved state follow.
+    public var precision: PARAM_ITEM_FILTER_PRECISION {
+        get {
+            return PARAM_ITEM_FILTER_PRECISION(rawValue: kernelAdapter.precision) ?? .AUTOMATIC
+        }
+        set {
+            parameters.precisionParam.value = AUValue(newValue.rawValue)
+        }
+    }
+
+    // MIDI controllers bound to parameters; see FilterDSPKernelAdapter.
+    public func mapController(_ controller: Int, to parameter: AUParameter) {
+        kernelAdapter.mapController(controller, toParameter: parameter.address)
+    }
+
+    public func unmapController(_ controller: Int) {
+        kernelAdapter.unmapController(controller)
+    }
+
+    // Binds whichever controller moves next to the parameter.
+    public func learnController(for parameter: AUParameter) {
+        kernelAdapter.learnControllerForParameter(parameter.address)
+    }
+
+    public func cancelControllerLearn() {
+        kernelAdapter.cancelControllerLearn()
+    }
+
+    public var isLearningController: Bool {
+        return kernelAdapter.isLearningController
+    }
+
+    // Offline renders filter forward and backward (zero phase); the response
+    // curves show the squared magnitude that results.
+    public var zeroPhase: Bool {
+        get {
+            return kernelAdapter.isZeroPhase
+        }
+        set {
+            kernelAdapter.isZeroPhase = newValue
+        }
+    }
+
+    // Filters a whole file with the current settings, using every core.
+    // Blocks until done; see FilterDSPKernelAdapter for the tolerance.
+    public func renderFile(at inputURL: URL, to outputURL: URL, tolerance: Double = 1e-6) throws {
+        try kernelAdapter.renderFile(at: inputURL, to: outputURL, tolerance: tolerance)
+    }
+
+    // Logs every render callback to a file that Tools/RenderSessionReplay
+    // can play back. Without audio the replay feeds the filter test noise.
+    public func startRecordingSession(to url: URL, includeAudio: Bool = true) throws {
+        try kernelAdapter.startRecordingSession(to: url, includeAudio: includeAudio)
+    }
+
+    // Returns false if part of the file couldn't be written.
+    @discardableResult
+    public func stopRecordingSession() -> Bool {
+        return kernelAdapter.stopRecordingSession()
+    }
+
+    public var isRecordingSession: Bool {
+        return kernelAdapter.isRecordingSession
+    }
+	
 	public func ramp() -> [NSNumber] {
 		return kernelAdapter.ramp()
 	}
@@ -177,11 +333,23 @@ public class BiquadFilterAU: AUAudioUnit {
         }
         try super.allocateRenderResources()
         kernelAdapter.allocateRenderResources()
+
+        let timer = DispatchSource.makeTimerSource(queue: .main)
+        timer.schedule(deadline: .now(), repeating: .milliseconds(30))
+        timer.setEventHandler { [weak self] in
+            guard let self = self else { return }
+            self.parameters.publishValues(movedBy: self.kernelAdapter.takeParametersMovedByControllers(),
+                                          kernelAdapter: self.kernelAdapter)
+        }
+        timer.resume()
+        controllerChangeTimer = timer
     }
 	
 	
 
     public override func deallocateRenderResources() {
+        controllerChangeTimer?.cancel()
+        controllerChangeTimer = nil
         super.deallocateRenderResources()
         kernelAdapter.deallocateRenderResources()
     }
@@ -190,6 +358,11 @@ public class BiquadFilterAU: AUAudioUnit {
         return kernelAdapter.internalRenderBlock()
     }
 
+    // For the renderContextObserver override in FilterDSPKernelAdapter.mm, which Swift can't write.
+    @objc public var renderingKernelAdapter: FilterDSPKernelAdapter {
+        return kernelAdapter
+    }
+
     // A Boolean value that indicates whether the audio unit can process the input
     // audio in-place in the input buffer without requiring a separate output buffer.
     public override var canProcessInPlace: Bool {
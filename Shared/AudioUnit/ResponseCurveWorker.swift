@@ -0,0 +1,134 @@
+//
+//  ResponseCurveWorker.swift
+//  BiquadFilter
+//
+//  Computes response curves off the main thread and memoizes them.
+//
+
+import Accelerate
+import Foundation
+
+// The parameters that fully determine a response curve.
+struct ResponseCurveKey: Hashable {
+    let cutoff: AUValue
+    let resonance: AUValue
+    let filterType: Int
+    let sampleRate: Double
+    var zeroPhase = false    // forward-backward: the magnitude is squared
+}
+
+struct ResponseCurve {
+    let key: ResponseCurveKey
+    let coefficients: BiquadCoefficientsPOD
+    let magnitudes: [Float]
+}
+
+// The `ResponseCurveWorker` turns bursts of parameter changes (such as a
+// slider drag) into at most one background computation at a time. Requests
+// that arrive while one is running are coalesced down to the newest, and
+// results that are stale by the time they finish are cached but never
+// delivered. Finished curves are kept in a small LRU cache, so revisiting a
+// position costs nothing.
+//
+// Call everything from the main thread; completions arrive on the main thread.
+class ResponseCurveWorker {
+
+    let cacheCapacity: Int
+
+    private let calculate: (ResponseCurveKey) -> BiquadCoefficientsPOD
+    private let mrc: MagnitudeResponseCalculator
+    private let queue = DispatchQueue(label: "BiquadFilter.ResponseCurveWorker", qos: .userInitiated)
+
+    // Main-thread state.
+    private var cache = [ResponseCurveKey: ResponseCurve]()
+    private var recentlyUsed = [ResponseCurveKey]()    // least recent first
+    private var cachedSampleRate: Double?
+    private var latest: (key: ResponseCurveKey, completion: (ResponseCurve) -> Void)?
+    private var isComputing = false
+
+    // `calculate` must be safe to call from a background queue.
+    init(sampleCount: Int = gMRCSampleCount,
+         cacheCapacity: Int = 64,
+         calculate: @escaping (ResponseCurveKey) -> BiquadCoefficientsPOD) {
+        self.cacheCapacity = cacheCapacity
+        self.calculate = calculate
+        mrc = MagnitudeResponseCalculator(sampleCount: sampleCount)
+    }
+
+    func request(_ key: ResponseCurveKey, completion: @escaping (ResponseCurve) -> Void) {
+        dispatchPrecondition(condition: .onQueue(.main))
+
+        // Curves computed at another sample rate are worthless now.
+        if key.sampleRate != cachedSampleRate {
+            cache.removeAll()
+            recentlyUsed.removeAll()
+            cachedSampleRate = key.sampleRate
+        }
+
+        if let curve = cache[key] {
+            touch(key)
+            latest = nil
+            completion(curve)
+            return
+        }
+
+        latest = (key, completion)
+        computeLatestIfIdle()
+    }
+
+    func invalidate() {
+        dispatchPrecondition(condition: .onQueue(.main))
+        cache.removeAll()
+        recentlyUsed.removeAll()
+    }
+
+    private func computeLatestIfIdle() {
+        guard !isComputing, let key = latest?.key else { return }
+
+        isComputing = true
+        queue.async { [calculate, mrc] in
+            let coefficients = calculate(key)
+            var magnitudes = mrc.response(for: coefficients)
+            if key.zeroPhase {
+                magnitudes = vDSP.square(magnitudes)
+            }
+            let curve = ResponseCurve(key: key,
+                                      coefficients: coefficients,
+                                      magnitudes: magnitudes)
+            DispatchQueue.main.async { [weak self] in
+                self?.finish(curve)
+            }
+        }
+    }
+
+    private func finish(_ curve: ResponseCurve) {
+        isComputing = false
+
+        if curve.key.sampleRate == cachedSampleRate {
+            insert(curve)
+        }
+
+        if let pending = latest, pending.key == curve.key {
+            latest = nil
+            pending.completion(curve)
+        } else {
+            // A newer request arrived while this one ran.
+            computeLatestIfIdle()
+        }
+    }
+
+    private func insert(_ curve: ResponseCurve) {
+        cache[curve.key] = curve
+        touch(curve.key)
+        if recentlyUsed.count > cacheCapacity {
+            cache.removeValue(forKey: recentlyUsed.removeFirst())
+        }
+    }
+
+    private func touch(_ key: ResponseCurveKey) {
+        if let index = recentlyUsed.firstIndex(of: key) {
+            recentlyUsed.remove(at: index)
+        }
+        recentlyUsed.append(key)
+    }
+}
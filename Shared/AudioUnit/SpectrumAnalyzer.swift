@@ -0,0 +1,174 @@
+//
+//  SpectrumAnalyzer.swift
+//  BiquadFilter
+//
+//  Reads the kernel's metering tap off the audio thread and computes
+//  pre- and post-filter magnitude spectra.
+//
+
+import Accelerate
+
+// The `SpectrumAnalyzer` polls the metering tap on a background queue. The
+// tap is only enabled between `start` and `stop`, so the render thread pays
+// nothing while no one is listening.
+class SpectrumAnalyzer {
+
+    struct Snapshot {
+        let inputSpectrum: [Float]     // dBFS, one value per bin
+        let outputSpectrum: [Float]    // dBFS, one value per bin
+        let binWidth: Double           // Hz
+        let sampleRate: Double         // the audio unit's sample rate
+        let inputPeaks: [Float]        // per channel, linear
+        let inputRMS: [Float]          // per channel, linear
+        let peaks: [Float]             // output, per channel, linear
+        let rms: [Float]               // output, per channel, linear
+        let costMicroseconds: Double
+        let maximumCostMicroseconds: Double
+    }
+
+    let fftSize: Int
+    let updateInterval: DispatchTimeInterval
+
+    private let kernelAdapter: FilterDSPKernelAdapter
+    private let queue = DispatchQueue(label: "BiquadFilter.SpectrumAnalyzer", qos: .utility)
+    private var timer: DispatchSourceTimer?
+
+    private let log2n: vDSP_Length
+    private let fftSetup: FFTSetup
+    private let window: [Float]
+    private let powerScale: Float
+
+    // Only touched on `queue`.
+    private var inputHistory: [Float]
+    private var outputHistory: [Float]
+    private var inputChunk: [Float]
+    private var outputChunk: [Float]
+
+    init(kernelAdapter: FilterDSPKernelAdapter, fftSize: Int = 2048, updateInterval: DispatchTimeInterval = .milliseconds(33)) {
+        precondition(fftSize > 0 && fftSize & (fftSize - 1) == 0, "fftSize must be a power of two")
+
+        self.kernelAdapter = kernelAdapter
+        self.fftSize = fftSize
+        self.updateInterval = updateInterval
+
+        log2n = vDSP_Length(log2(Double(fftSize)))
+        fftSetup = vDSP_create_fftsetup(log2n, FFTRadix(kFFTRadix2))!
+
+        var hann = [Float](repeating: 0, count: fftSize)
+        vDSP_hann_window(&hann, vDSP_Length(fftSize), Int32(vDSP_HANN_NORM))
+        window = hann
+
+        // vDSP_fft_zrip returns twice the true DFT, so a full-scale sine peaks at sum(window).
+        let windowSum = hann.reduce(0, +)
+        powerScale = 1.0 / (windowSum * windowSum)
+
+        inputHistory = [Float](repeating: 0, count: fftSize)
+        outputHistory = [Float](repeating: 0, count: fftSize)
+        inputChunk = [Float](repeating: 0, count: fftSize)
+        outputChunk = [Float](repeating: 0, count: fftSize)
+    }
+
+    deinit {
+        timer?.cancel()
+        kernelAdapter.isMeteringEnabled = false
+        vDSP_destroy_fftsetup(fftSetup)
+    }
+
+    var isRunning: Bool {
+        return timer != nil
+    }
+
+    // Enables the tap and delivers snapshots to `handler` on the main queue.
+    func start(_ handler: @escaping (Snapshot) -> Void) {
+        guard timer == nil else { return }
+
+        kernelAdapter.isMeteringEnabled = true
+
+        let timer = DispatchSource.makeTimerSource(queue: queue)
+        timer.schedule(deadline: .now(), repeating: updateInterval)
+        timer.setEventHandler { [weak self] in
+            guard let self = self, let snapshot = self.poll() else { return }
+            DispatchQueue.main.async {
+                handler(snapshot)
+            }
+        }
+        timer.resume()
+        self.timer = timer
+    }
+
+    // Disables the tap. Pending snapshots may still arrive on the main queue.
+    func stop() {
+        timer?.cancel()
+        timer = nil
+        kernelAdapter.isMeteringEnabled = false
+    }
+
+    private func poll() -> Snapshot? {
+        let count = inputChunk.withUnsafeMutableBufferPointer { input in
+            outputChunk.withUnsafeMutableBufferPointer { output in
+                kernelAdapter.readMeteringInput(input.baseAddress!, output: output.baseAddress!, count: fftSize)
+            }
+        }
+        guard count > 0 else { return nil }
+
+        // Slide the newest samples into the analysis windows.
+        inputHistory.removeFirst(count)
+        inputHistory.append(contentsOf: inputChunk[0 ..< count])
+        outputHistory.removeFirst(count)
+        outputHistory.append(contentsOf: outputChunk[0 ..< count])
+
+        let channelCount = kernelAdapter.meteringChannelCount
+        let inputPeaks = (0 ..< channelCount).map { kernelAdapter.inputPeak(forChannel: $0) }
+        let inputRMS = (0 ..< channelCount).map { kernelAdapter.inputRMS(forChannel: $0) }
+        let peaks = (0 ..< channelCount).map { kernelAdapter.peak(forChannel: $0) }
+        let rms = (0 ..< channelCount).map { kernelAdapter.rms(forChannel: $0) }
+
+        return Snapshot(inputSpectrum: spectrum(of: inputHistory),
+                        outputSpectrum: spectrum(of: outputHistory),
+                        binWidth: kernelAdapter.meteringSampleRate / Double(fftSize),
+                        sampleRate: kernelAdapter.outputBus.format.sampleRate,
+                        inputPeaks: inputPeaks,
+                        inputRMS: inputRMS,
+                        peaks: peaks,
+                        rms: rms,
+                        costMicroseconds: kernelAdapter.meteringCostMicroseconds,
+                        maximumCostMicroseconds: kernelAdapter.maximumMeteringCostMicroseconds)
+    }
+
+    private func spectrum(of samples: [Float]) -> [Float] {
+        let half = fftSize / 2
+        var windowed = [Float](repeating: 0, count: fftSize)
+        vDSP_vmul(samples, 1, window, 1, &windowed, 1, vDSP_Length(fftSize))
+
+        var real = [Float](repeating: 0, count: half)
+        var imaginary = [Float](repeating: 0, count: half)
+        var power = [Float](repeating: 0, count: half)
+
+        real.withUnsafeMutableBufferPointer { realPointer in
+            imaginary.withUnsafeMutableBufferPointer { imaginaryPointer in
+                var split = DSPSplitComplex(realp: realPointer.baseAddress!, imagp: imaginaryPointer.baseAddress!)
+                windowed.withUnsafeBytes { bytes in
+                    vDSP_ctoz(bytes.bindMemory(to: DSPComplex.self).baseAddress!, 2, &split, 1, vDSP_Length(half))
+                }
+                vDSP_fft_zrip(fftSetup, &split, 1, log2n, FFTDirection(FFT_FORWARD))
+                vDSP_zvmags(&split, 1, &power, 1, vDSP_Length(half))
+            }
+        }
+
+        // Bin 0 holds DC and Nyquist packed together; drop the Nyquist part.
+        power[0] = real[0] * real[0]
+
+        var scale = powerScale
+        vDSP_vsmul(power, 1, &scale, &power, 1, vDSP_Length(half))
+
+        // Floor at -140 dBFS before the log.
+        var floor: Float = 1e-14
+        var ceiling: Float = .greatestFiniteMagnitude
+        vDSP_vclip(power, 1, &floor, &ceiling, &power, 1, vDSP_Length(half))
+
+        var reference: Float = 1.0
+        var decibels = [Float](repeating: 0, count: half)
+        vDSP_vdbcon(power, 1, &reference, &decibels, 1, vDSP_Length(half), 0)
+        return decibels
+    }
+}
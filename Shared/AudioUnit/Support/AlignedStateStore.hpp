@@ -0,0 +1,108 @@
+//
+//  AlignedStateStore.hpp
+//  BiquadFilter
+//
+//  Fixed-capacity, cache-line-aligned storage for per-channel DSP state.
+//
+
+#ifndef AlignedStateStore_hpp
+#define AlignedStateStore_hpp
+
+#import <algorithm>
+#import <cstdlib>
+#import <stdlib.h>
+#import <new>
+
+static constexpr size_t kCacheLineSize = 64;
+
+/*
+ AlignedStateStore
+ Holds one State per channel in a single cache-line-aligned block.
+
+ The block is sized once, off the render thread, by allocate(). After that,
+ setCount() only changes how many entries are active, so switching the
+ channel count or sample rate never touches the heap. State must pack evenly
+ into a cache line so that neighbouring channels share lines and no channel
+ straddles two of them.
+ */
+template <typename State>
+class AlignedStateStore {
+public:
+    static_assert(kCacheLineSize % sizeof(State) == 0,
+                  "State must pack evenly into a cache line.");
+
+    static constexpr int statesPerCacheLine = int(kCacheLineSize / sizeof(State));
+
+    AlignedStateStore() {}
+    AlignedStateStore(const AlignedStateStore&) = delete;
+    AlignedStateStore& operator=(const AlignedStateStore&) = delete;
+
+    ~AlignedStateStore() {
+        deallocate();
+    }
+
+    /*
+     Grows the block to hold at least inCapacity channels. Does nothing if the
+     current block is already large enough. Not real-time safe.
+     */
+    void allocate(int inCapacity) {
+        if (inCapacity <= capacity) {
+            return;
+        }
+
+        // Round up to whole cache lines so the last line is never shared.
+        int roundedCapacity = (inCapacity + statesPerCacheLine - 1) / statesPerCacheLine * statesPerCacheLine;
+        void* block = nullptr;
+        if (posix_memalign(&block, kCacheLineSize, roundedCapacity * sizeof(State)) != 0) {
+            throw std::bad_alloc();
+        }
+
+        int activeCount = count;
+        deallocate();
+
+        states = static_cast<State*>(block);
+        for (int i = 0; i < roundedCapacity; ++i) {
+            new (&states[i]) State();
+        }
+        capacity = roundedCapacity;
+        count = activeCount;
+    }
+
+    void deallocate() {
+        if (states == nullptr) {
+            return;
+        }
+        for (int i = 0; i < capacity; ++i) {
+            states[i].~State();
+        }
+        std::free(states);
+        states = nullptr;
+        capacity = 0;
+        count = 0;
+    }
+
+    // Real-time safe. Clamps to the allocated capacity.
+    void setCount(int inCount) {
+        count = clampCount(inCount);
+    }
+
+    int clampCount(int inCount) const {
+        return std::min(std::max(inCount, 0), capacity);
+    }
+
+    int size() const { return count; }
+    int maximumSize() const { return capacity; }
+
+    State& operator[](int index) { return states[index]; }
+    const State& operator[](int index) const { return states[index]; }
+
+    State* begin() { return states; }
+    State* end() { return states + count; }
+
+private:
+    State* states = nullptr;
+    int capacity = 0;
+    int count = 0;
+};
+
+#endif /* AlignedStateStore_hpp */
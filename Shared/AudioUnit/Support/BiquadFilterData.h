@@ -18,4 +18,17 @@ typedef NS_ENUM(NSInteger, PARAM_ITEM_FILTER_TYPE) {
 	PARAM_ITEM_FILTER_TYPE_PEAKINGEQ,
 };
 
+typedef NS_ENUM(NSInteger, PARAM_ITEM_FILTER_TOPOLOGY) {
+	PARAM_ITEM_FILTER_TOPOLOGY_BIQUAD,	// Direct Form I
+	PARAM_ITEM_FILTER_TOPOLOGY_SVF,		// TPT state-variable, for fast modulation
+};
+
+// How the biquad topology is computed. See PreciseBiquad.hpp.
+typedef NS_ENUM(NSInteger, PARAM_ITEM_FILTER_PRECISION) {
+	PARAM_ITEM_FILTER_PRECISION_AUTOMATIC,		// error feedback at low cutoffs, single otherwise
+	PARAM_ITEM_FILTER_PRECISION_SINGLE,
+	PARAM_ITEM_FILTER_PRECISION_ERROR_FEEDBACK,	// float, with near-double accuracy
+	PARAM_ITEM_FILTER_PRECISION_DOUBLE,
+};
+
 #endif /* BiquadFilterData_h */
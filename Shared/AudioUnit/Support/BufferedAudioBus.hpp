@@ -8,6 +8,8 @@ Utility classes to manage audio formats and buffers for an audio unit implementa
 #import <AudioToolbox/AudioToolbox.h>
 #import <AudioUnit/AudioUnit.h>
 #import <AVFoundation/AVFoundation.h>
+#import <stddef.h>
+#import <stdlib.h>
 
 #pragma mark BufferedAudioBus Utility Class
 
@@ -118,15 +120,64 @@ struct BufferedInputBus : BufferedAudioBus {
      
      The upstream audio unit may overwrite these with its own pointers, so call this
      function for each render cycle to reset them.
+
+     The prepared list is built once and only rebuilt when the frame count
+     changes, so in the steady state this is a single memcpy.
      */
     void prepareInputBufferList(UInt32 frameCount) {
+        if (frameCount != preparedFrameCount) {
+            buildPreparedAudioBufferList(frameCount);
+        }
+        memcpy(mutableAudioBufferList, preparedAudioBufferList, preparedListSize);
+    }
+
+    void allocateRenderResources(AUAudioFrameCount inMaxFrames) {
+        BufferedAudioBus::allocateRenderResources(inMaxFrames);
+
+        freePreparedAudioBufferList();
+        UInt32 bufferCount = std::max(originalAudioBufferList->mNumberBuffers, UInt32(1));
+        preparedListSize = offsetof(AudioBufferList, mBuffers) + bufferCount * sizeof(AudioBuffer);
+        preparedAudioBufferList = (AudioBufferList*)malloc(preparedListSize);
+        buildPreparedAudioBufferList(maxFrames);
+    }
+
+    void deallocateRenderResources() {
+        BufferedAudioBus::deallocateRenderResources();
+        freePreparedAudioBufferList();
+    }
+
+    BufferedInputBus() = default;
+
+    ~BufferedInputBus() {
+        freePreparedAudioBufferList();
+    }
+
+    // Owns preparedAudioBufferList, so a copy would free it twice.
+    BufferedInputBus(const BufferedInputBus&) = delete;
+    BufferedInputBus& operator=(const BufferedInputBus&) = delete;
+
+private:
+    // Doesn't allocate, so it's safe on the render thread.
+    void buildPreparedAudioBufferList(UInt32 frameCount) {
         UInt32 byteSize = std::min(frameCount, maxFrames) * sizeof(float);
-        mutableAudioBufferList->mNumberBuffers = originalAudioBufferList->mNumberBuffers;
+        preparedAudioBufferList->mNumberBuffers = originalAudioBufferList->mNumberBuffers;
 
         for (UInt32 i = 0; i < originalAudioBufferList->mNumberBuffers; ++i) {
-            mutableAudioBufferList->mBuffers[i].mNumberChannels = originalAudioBufferList->mBuffers[i].mNumberChannels;
-            mutableAudioBufferList->mBuffers[i].mData = originalAudioBufferList->mBuffers[i].mData;
-            mutableAudioBufferList->mBuffers[i].mDataByteSize = byteSize;
+            preparedAudioBufferList->mBuffers[i].mNumberChannels = originalAudioBufferList->mBuffers[i].mNumberChannels;
+            preparedAudioBufferList->mBuffers[i].mData = originalAudioBufferList->mBuffers[i].mData;
+            preparedAudioBufferList->mBuffers[i].mDataByteSize = byteSize;
         }
+        preparedFrameCount = frameCount;
+    }
+
+    void freePreparedAudioBufferList() {
+        free(preparedAudioBufferList);
+        preparedAudioBufferList = nullptr;
+        preparedListSize = 0;
+        preparedFrameCount = 0;
     }
+
+    AudioBufferList* preparedAudioBufferList = nullptr;
+    size_t preparedListSize = 0;
+    UInt32 preparedFrameCount = 0;
 };
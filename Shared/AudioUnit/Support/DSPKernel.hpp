@@ -10,12 +10,41 @@ The utility code to manage scheduled parameters in an audio unit implementation.
 
 #import <AudioToolbox/AudioToolbox.h>
 #import <algorithm>
+#import <cmath>
 
 template <typename T>
 T clamp(T input, T low, T high) {
     return std::min(std::max(input, low), high);
 }
 
+static inline float convertBadValuesToZero(float x) {
+    /*
+     Eliminate denormals, not-a-numbers, and infinities.
+     Denormals fails the first test (absx > 1e-15), infinities fails
+     the second test (absx < 1e15), and NaNs fails both tests. Zero will
+     also fail both tests, but because the system sets it to zero, that's OK.
+     */
+
+    float absx = fabs(x);
+
+    if (absx > 1e-15 && absx < 1e15) {
+        return x;
+    }
+
+    return 0.0;
+}
+
+// The same limits, for state kept in double.
+static inline double convertBadValuesToZero(double x) {
+    double absx = fabs(x);
+
+    if (absx > 1e-15 && absx < 1e15) {
+        return x;
+    }
+
+    return 0.0;
+}
+
 // Put your DSP code into a subclass of DSPKernel.
 class DSPKernel {
 public:
@@ -25,6 +54,15 @@ public:
     // Override to handle MIDI events.
     virtual void handleMIDIEvent(AUMIDIEvent const& midiEvent) {}
 
+    /*
+     Kernels that apply MIDI at control rate override these. Their MIDI
+     events don't split the buffer: processWithEvents hands each one over as
+     soon as it reaches it, with its frame offset into the buffer, and the
+     kernel applies it when that frame comes round.
+     */
+    virtual bool schedulesMIDIEvents() const { return false; }
+    virtual void scheduleMIDIEvent(AUMIDIEvent const& midiEvent, AUAudioFrameCount frameOffset) {}
+
     void processWithEvents(AudioTimeStamp const* timestamp, AUAudioFrameCount frameCount, AURenderEvent const* events, AUMIDIOutputEventBlock midiOut);
 
     AUAudioFrameCount maximumFramesToRender() const {
@@ -48,9 +48,11 @@ void DSPKernel::performAllSimultaneousEvents(AUEventSampleTime now, AURenderEven
  */
 void DSPKernel::processWithEvents(AudioTimeStamp const *timestamp, AUAudioFrameCount frameCount, AURenderEvent const *events, AUMIDIOutputEventBlock midiOut) {
 
-    AUEventSampleTime now = AUEventSampleTime(timestamp->mSampleTime);
+    AUEventSampleTime const startTime = AUEventSampleTime(timestamp->mSampleTime);
+    AUEventSampleTime now = startTime;
     AUAudioFrameCount framesRemaining = frameCount;
     AURenderEvent const *event = events;
+    bool const schedulesMIDI = schedulesMIDIEvents();
 
     while (framesRemaining > 0) {
         // If there are no more events, process the entire remaining segment and exit.
@@ -63,6 +65,18 @@ void DSPKernel::processWithEvents(AudioTimeStamp const *timestamp, AUAudioFrameC
         // **** start late events late.
         auto timeZero = AUEventSampleTime(0);
         auto headEventTime = event->head.eventSampleTime;
+
+        if (schedulesMIDI && event->head.eventType == AURenderEventMIDI) {
+            // Late events go at the start; none go past the last frame.
+            AUEventSampleTime const offset = std::min(std::max(headEventTime - startTime, now - startTime),
+                                                      AUEventSampleTime(frameCount - 1));
+            scheduleMIDIEvent(event->MIDI, AUAudioFrameCount(offset));
+            if (midiOut) {
+                midiOut(startTime + offset, 0, event->MIDI.length, event->MIDI.data);
+            }
+            event = event->head.next;
+            continue;
+        }
         AUAudioFrameCount const framesThisSegment = AUAudioFrameCount(std::max(timeZero, headEventTime - now));
 
         // Compute everything before the next event.
@@ -0,0 +1,92 @@
+//
+//  EnvelopeFollower.hpp
+//  BiquadFilter
+//
+//  A control-rate peak envelope follower for the auto-filter mode.
+//
+
+#ifndef EnvelopeFollower_hpp
+#define EnvelopeFollower_hpp
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <cmath>
+
+#import "DSPKernel.hpp"
+
+/*
+ EnvelopeFollower
+ accumulate() rectifies the detector signal as the render loop goes; once
+ per control period update() turns the period's peak into the envelope with
+ separate attack and release ballistics. The per-sample cost is a fabs and a
+ max, so an auto filter costs little more than a static one.
+ */
+class EnvelopeFollower {
+public:
+    void setAttack(float milliseconds) {
+        attackTime = clamp(milliseconds, 0.01f, 5000.0f) * 0.001f;
+        ballisticsChanged = true;
+    }
+
+    void setRelease(float milliseconds) {
+        releaseTime = clamp(milliseconds, 0.01f, 5000.0f) * 0.001f;
+        ballisticsChanged = true;
+    }
+
+    float attackMilliseconds() const { return attackTime * 1000.0f; }
+    float releaseMilliseconds() const { return releaseTime * 1000.0f; }
+
+    void reset() {
+        envelope = 0.0;
+        periodPeak = 0.0;
+    }
+
+    // Render thread. Scans frameCount frames starting at bufferOffset.
+    void accumulate(const AudioBufferList* bufferList, AUAudioFrameCount frameCount, AUAudioFrameCount bufferOffset) {
+        float peak = periodPeak;
+        for (UInt32 channel = 0; channel < bufferList->mNumberBuffers; ++channel) {
+            const float* samples = (const float*)bufferList->mBuffers[channel].mData + bufferOffset;
+            for (AUAudioFrameCount i = 0; i < frameCount; ++i) {
+                peak = std::max(peak, std::fabs(samples[i]));
+            }
+        }
+        periodPeak = peak;
+    }
+
+    // Render thread. Call once per control period; returns the new envelope.
+    float update(AUAudioFrameCount periodFrames, float sampleRate) {
+        if (ballisticsChanged || periodFrames != ballisticsFrames || sampleRate != ballisticsSampleRate) {
+            // Only recalculated when a setting changes; exp() is too costly per period.
+            attackCoefficient = std::exp(-float(periodFrames) / (attackTime * sampleRate));
+            releaseCoefficient = std::exp(-float(periodFrames) / (releaseTime * sampleRate));
+            ballisticsFrames = periodFrames;
+            ballisticsSampleRate = sampleRate;
+            ballisticsChanged = false;
+        }
+
+        float level = convertBadValuesToZero(periodPeak);
+        float coefficient = level > envelope ? attackCoefficient : releaseCoefficient;
+        envelope = level + coefficient * (envelope - level);
+        periodPeak = 0.0;
+
+        return envelope;
+    }
+
+    float value() const {
+        return envelope;
+    }
+
+private:
+    float attackTime = 0.01;
+    float releaseTime = 0.15;
+
+    float attackCoefficient = 0.0;
+    float releaseCoefficient = 0.0;
+    AUAudioFrameCount ballisticsFrames = 0;
+    float ballisticsSampleRate = 0.0;
+    bool ballisticsChanged = true;
+
+    float envelope = 0.0;
+    float periodPeak = 0.0;
+};
+
+#endif /* EnvelopeFollower_hpp */
@@ -11,30 +11,35 @@ A DSPKernel subclass that implements the real-time signal processing portion of
 #import "ParameterRamper.hpp"
 #import "BiquadFilterData.h"
 #import "BiquadCoefficientCalculator.hpp"
+#import "AlignedStateStore.hpp"
+#import "MeteringTap.hpp"
+#import "StateVariableFilter.hpp"
+#import "EnvelopeFollower.hpp"
+#import "RenderWorkerPool.hpp"
+#import "KernelDispatch.hpp"
+#import "PreciseBiquad.hpp"
+#import "MIDIControl.hpp"
+#import <chrono>
+#import <cstddef>
 #import <vector>
 
-static inline float convertBadValuesToZero(float x) {
-    /*
-     Eliminate denormals, not-a-numbers, and infinities.
-     Denormals fails the first test (absx > 1e-15), infinities fails
-     the second test (absx < 1e15), and NaNs fails both tests. Zero will
-     also fail both tests, but because the system sets it to zero, that's OK.
-     */
-
-    float absx = fabs(x);
-
-    if (absx > 1e-15 && absx < 1e15) {
-        return x;
-    }
-
-    return 0.0;
-}
-
-
 enum {
     FilterParamCutoff = 0,
 	FilterParamResonance = 1,
 	FilterParamType = 2,
+	FilterParamTopology = 3,
+	FilterParamAutoFilter = 4,
+	FilterParamAutoFilterAttack = 5,
+	FilterParamAutoFilterRelease = 6,
+	FilterParamAutoFilterDepth = 7,
+	FilterParamAutoFilterSidechain = 8,
+	FilterParamControlInterval = 9,
+	FilterParamKeyTracking = 10,
+	FilterParamPitchBendRange = 11,
+	FilterParamControlSmoothing = 12,
+	FilterParamPrecision = 13,
+	// One past the last address.
+	FilterParamCount
 };
 
 static inline double squared(double x) {
@@ -45,8 +50,10 @@ static inline double squared(double x) {
  FilterDSPKernel
  Performs the filter signal processing.
  As a non-ObjC class, this is safe to use from the render thread.
+ It's final so that calls through a FilterDSPKernel pointer don't go
+ through the vtable.
  */
-class FilterDSPKernel : public DSPKernel {
+class FilterDSPKernel final : public DSPKernel {
 public:
     // MARK: Types
     struct FilterState {
@@ -114,76 +121,18 @@ public:
 								   PARAM_ITEM_FILTER_TYPE filterType,
 								   double sampleRate)
 		{
-			
-			float omega = 2.0 * M_PI * frequency / float(sampleRate);
-			float sinOmega = sin(omega);
-			float alpha = sinOmega / (2 * resonance);
-			float cosOmega = cos(omega);
-			
-			float a0;
-
-			switch (filterType) {
-			case PARAM_ITEM_FILTER_TYPE_PASSTHROUGH:
-//				b0 = passthroughCoefficients.b0;  <-- example
-				b0 = 1.0;
-				b1 = 0.0;
-				b2 = 0.0;
-				a0 = 1.0;
-				a1 = 0.0;
-				a2 = 0.0;
-				break;
-			case PARAM_ITEM_FILTER_TYPE_LOWPASS:
-				b0 = (1.0 - cosOmega) / 2.0;
-				b1 = 1.0 - cosOmega;
-				b2 = (1.0 - cosOmega) / 2.0;
-				a0 = 1 + alpha;
-				a1 = -2.0 * cosOmega;
-				a2 = 1.0 - alpha;
-				break;
-			case PARAM_ITEM_FILTER_TYPE_HIGHPASS:
-				b0 = (1.0 + cosOmega) / 2.0;
-				b1 = -(1.0 + cosOmega);
-				b2 = (1.0 + cosOmega) / 2.0;
-				a0 = 1.0 + alpha;
-				a1 = -2.0 * cosOmega;
-				a2 = 1 - alpha;
-				break;
-			case PARAM_ITEM_FILTER_TYPE_BANDPASS:
-				b0 = alpha;
-				b1 = 0.0;
-				b2 = -alpha;
-				a0 = 1.0 + alpha;
-				a1 = -2.0 * cosOmega;
-				a2 = 1.0 - alpha;
-				break;
-			case PARAM_ITEM_FILTER_TYPE_NOTCH:
-				b0 = 1.0;
-				b1 = -2.0 * cosOmega;
-				b2 = 1.0;
-				a0 = 1.0 + alpha;
-				a1 = -2.0 * cosOmega;
-				a2 = 1.0 - alpha;
-				break;
-			case PARAM_ITEM_FILTER_TYPE_PEAKINGEQ:
-				{
-					// Curve that sort of fits, not great.
-					// Want to control all filters with the q/rez param.
-					float dbGain = 18.1 * log(resonance) - 8.33;
-					float A = pow(10.0, dbGain / 40.0);
-					b0 = 1.0 + alpha * A;
-					b1 = -2.0 * cosOmega;
-					b2 = 1.0 - alpha * A;
-					a0 = 1.0 + alpha / A;
-					a1 = -2.0 * cosOmega;
-					a2 = 1.0 - alpha / A;
-				}
-				break;
-			}
-			b0 /= a0;
-			b1 /= a0;
-			b2 /= a0;
-			a1 /= a0;
-			a2 /= a0;
+			// Designed in double and rounded once, so low cutoffs keep their pole radius.
+			PreciseBiquadCoefficients precise;
+			precise.calculateCoefficients(frequency, resonance, filterType, sampleRate);
+			assign(precise);
+		}
+
+		void assign(const PreciseBiquadCoefficients& precise) {
+			b0 = float(precise.b0);
+			b1 = float(precise.b1);
+			b2 = float(precise.b2);
+			a1 = float(precise.a1);
+			a2 = float(precise.a2);
 		}
 
         // Arguments in hertz.
@@ -218,18 +167,51 @@ public:
         }
     };
 
+    typedef ChannelKernels<DirectFormLoop, FilterState, KernelBiquadCoefficients> DirectFormKernels;
+    typedef ChannelKernels<ErrorFeedbackLoop, ErrorFeedbackFilterState, ErrorFeedbackBiquadCoefficients> ErrorFeedbackKernels;
+    typedef ChannelKernels<DoubleDirectFormLoop, DoubleFilterState, PreciseBiquadCoefficients> DoublePrecisionKernels;
+    typedef ChannelKernels<StateVariableLoop, StateVariableFilterState, StateVariableFilterCoefficients> StateVariableKernels;
+
     // MARK: Member Functions
 
 	//: cutoffRamper(400.0 / 44100.0), resonanceRamper(20.0)
 	FilterDSPKernel() {}
 
+    /*
+     Sizes the channel state store. Call this when allocating render resources,
+     never from the render thread. The store only grows, so a later init()
+     with any channel count up to maximumChannels doesn't allocate.
+     */
+    void allocateChannelStates(int maximumChannels) {
+        channelStates.allocate(maximumChannels);
+        errorFeedbackStates.allocate(maximumChannels);
+        doubleStates.allocate(maximumChannels);
+        svfStates.allocate(maximumChannels);
+    }
+
+    int maximumChannelCount() const {
+        return channelStates.maximumSize();
+    }
+
+    // Doesn't allocate; channelCount is clamped to the allocated capacity.
     void init(int channelCount, double inSampleRate) {
-        channelStates.resize(channelCount);
+        channelStates.setCount(channelCount);
+        errorFeedbackStates.setCount(channelCount);
+        doubleStates.setCount(channelCount);
+        svfStates.setCount(channelCount);
+        meteringTap.setSampleRate(inSampleRate);
 
         sampleRate = float(inSampleRate);
+        inverseSampleRate = 1.0 / sampleRate;
         nyquist = 0.5 * sampleRate;
         inverseNyquist = 1.0 / nyquist;
         dezipperRampDuration = (AUAudioFrameCount)floor(0.02 * sampleRate);
+
+        // Coefficients depend on the sample rate; force them to be recalculated.
+        dfCutoff = -1.0;
+        svfG = -1.0;
+
+        selectKernelVariant(kernelVariantOverride >= 0 ? kernelVariantOverride : preferredKernelVariant(channelStates.size()));
 //        cutoffRamper.init();
 //        resonanceRamper.init();
 
@@ -241,6 +223,16 @@ public:
         for (FilterState& state : channelStates) {
             state.clear();
         }
+        for (ErrorFeedbackFilterState& state : errorFeedbackStates) {
+            state.clear();
+        }
+        for (DoubleFilterState& state : doubleStates) {
+            state.clear();
+        }
+        for (StateVariableFilterState& state : svfStates) {
+            state.clear();
+        }
+        envelopeFollower.reset();
     }
 
     bool isBypassed() {
@@ -272,6 +264,39 @@ public:
 			case FilterParamType:
 				filterType = NSUInteger(value);
 				break;
+			case FilterParamTopology:
+				topology = NSUInteger(value);
+				break;
+			case FilterParamAutoFilter:
+				autoFilterEnabled = value >= 0.5f;
+				break;
+			case FilterParamAutoFilterAttack:
+				envelopeFollower.setAttack(value);
+				break;
+			case FilterParamAutoFilterRelease:
+				envelopeFollower.setRelease(value);
+				break;
+			case FilterParamAutoFilterDepth:
+				autoFilterDepth = clamp(value, -8.0f, 8.0f);
+				break;
+			case FilterParamAutoFilterSidechain:
+				autoFilterSidechain = value >= 0.5f;
+				break;
+			case FilterParamControlInterval:
+				controlInterval = AUAudioFrameCount(clamp(value, 1.0f, 4096.0f));
+				break;
+			case FilterParamKeyTracking:
+				keyTracking = clamp(value, 0.0f, 100.0f);
+				break;
+			case FilterParamPitchBendRange:
+				pitchBendRange = clamp(value, 0.0f, 48.0f);
+				break;
+			case FilterParamControlSmoothing:
+				controlSmoothing = clamp(value, 0.0f, 1000.0f);
+				break;
+			case FilterParamPrecision:
+				setPrecision(NSInteger(clamp(value, 0.0f, float(PARAM_ITEM_FILTER_PRECISION_DOUBLE))));
+				break;
 				
         }
     }
@@ -290,6 +315,28 @@ public:
 
 			case FilterParamType:
 				return filterType;
+			case FilterParamTopology:
+				return topology;
+			case FilterParamAutoFilter:
+				return autoFilterEnabled ? 1.0f : 0.0f;
+			case FilterParamAutoFilterAttack:
+				return envelopeFollower.attackMilliseconds();
+			case FilterParamAutoFilterRelease:
+				return envelopeFollower.releaseMilliseconds();
+			case FilterParamAutoFilterDepth:
+				return autoFilterDepth;
+			case FilterParamAutoFilterSidechain:
+				return autoFilterSidechain ? 1.0f : 0.0f;
+			case FilterParamControlInterval:
+				return controlInterval;
+			case FilterParamKeyTracking:
+				return keyTracking;
+			case FilterParamPitchBendRange:
+				return pitchBendRange;
+			case FilterParamControlSmoothing:
+				return controlSmoothing;
+			case FilterParamPrecision:
+				return precision;
 			
             default: return 12.0f * inverseNyquist;
         }
@@ -312,10 +359,31 @@ public:
         outBufferListPtr = outBufferList;
     }
 
+    // Not real-time safe. Call when allocating render resources.
+    void allocateMeteringTap(int maximumChannels, AUAudioFrameCount maximumFrames) {
+        meteringTap.allocate(maximumChannels, maximumFrames);
+    }
+
+    /*
+     Call meterInput() after setBuffers() and before processing, and
+     meterOutput() with what it returned once processing is done. Together
+     they cost one load when nobody is listening.
+     */
+    bool meterInput(AUAudioFrameCount frameCount) {
+        return meteringTap.captureInput(inBufferListPtr, channelStates.size(), frameCount);
+    }
+
+    void meterOutput(AUAudioFrameCount frameCount, bool meteredInput) {
+        meteringTap.captureOutput(outBufferListPtr, channelStates.size(), frameCount, meteredInput);
+    }
+
     void process(AUAudioFrameCount frameCount, AUAudioFrameCount bufferOffset) override {
         if (bypassed) {
+            // MIDI still lands, so the filter picks up where the controllers are.
+            applyScheduledMIDIEvents(bufferOffset + frameCount);
+
             // Pass the samples through.
-            int channelCount = int(channelStates.size());
+            int channelCount = channelStates.size();
             for (int channel = 0; channel < channelCount; ++channel) {
                 if (inBufferListPtr->mBuffers[channel].mData ==  outBufferListPtr->mBuffers[channel].mData) {
                     continue;
@@ -330,49 +398,744 @@ public:
             return;
         }
 
-        int channelCount = int(channelStates.size());
+        // The topology may change between calls; start the new one from silence.
+        if (topology != activeTopology) {
+            activeTopology = topology;
+            reset();
+        }
+        bool stateVariable = PARAM_ITEM_FILTER_TOPOLOGY(activeTopology) == PARAM_ITEM_FILTER_TOPOLOGY_SVF;
 
-//        cutoffRamper.dezipperCheck(dezipperRampDuration);
-//        resonanceRamper.dezipperCheck(dezipperRampDuration);
+        // Engaging the auto filter starts the envelope from rest.
+        bool modulating = autoFilterEnabled;
+        if (modulating != autoFilterActive) {
+            autoFilterActive = modulating;
+            envelopeFollower.reset();
+            envelopeOctaves = 0.0;
+            controlPhase = 0;
+        }
 
-        // For each sample.
-        for (int frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
-            /*
-             The filter coefficients update every sample. This is very
-             expensive. You probably want to do things differently.
-             */
-			double frequency    = this->cutoff;		// fixme ramping need a lot of work
-			double resonance    = this->resonance;
-			PARAM_ITEM_FILTER_TYPE lclFilterType = PARAM_ITEM_FILTER_TYPE(filterType);
-//           double frequency    = double(cutoffRamper.getAndStep());
-//            double resonance = double(resonanceRamper.getAndStep());
-			coeffs.calculateCoefficients(frequency, resonance, lclFilterType, sampleRate);
+        AUAudioFrameCount interval = std::max(controlInterval, AUAudioFrameCount(1));
+        if (controlPhase >= interval) {
+            controlPhase = 0;
+        }
+
+        /*
+         Render in control periods. Coefficients only change at period
+         boundaries, and only if the effective cutoff, resonance or type did.
+         Periods only run while something moves the filter: the auto filter,
+         or a MIDI glide. Otherwise the whole segment is a single period.
+         Either way a period is cut short where a scheduled MIDI event lands,
+         so every event is applied at its frame, within the render call that
+         scheduled it.
+         */
+        AUAudioFrameCount framesDone = 0;
+        while (framesDone < frameCount) {
+            AUAudioFrameCount periodFrames = frameCount - framesDone;
+            AUAudioFrameCount periodOffset = bufferOffset + framesDone;
+
+            applyScheduledMIDIEvents(periodOffset);
+            updateControlTargets();
+
+            bool periodic = modulating || isControlGliding();
+            if (periodic) {
+                periodFrames = std::min(periodFrames, interval - controlPhase);
+            }
+            else {
+                controlPhase = 0;
+            }
+            if (!scheduledMIDIEvents.isEmpty()) {
+                periodFrames = std::min(periodFrames, scheduledMIDIEvents.front().frameOffset - periodOffset);
+            }
+
+            if (modulating) {
+                // Detect before filtering, which may overwrite the input in place.
+                envelopeFollower.accumulate(detectorBufferList(), periodFrames, periodOffset);
+            }
+
+            float frequency = controlFrequency();
+            if (stateVariable) {
+                prepareStateVariable(periodFrames, frequency, periodic);
+            }
+            else {
+                prepareDirectForm(frequency);
+            }
+            renderChannels(periodFrames, periodOffset, stateVariable);
+            if (stateVariable) {
+                finishStateVariable();
+            }
+
+            framesDone += periodFrames;
+
+            if (periodic) {
+                controlPhase += periodFrames;
+                if (controlPhase >= interval) {
+                    controlPhase = 0;
+                    updateControl(interval, modulating);
+                }
+            }
+        }
+    }
+
+    /*
+     The render block's path when there are no events to schedule, which is
+     nearly every call. It skips processWithEvents and, because the class is
+     final, the virtual dispatch to process().
+     */
+    void processWithoutEvents(AUAudioFrameCount frameCount) {
+        process(frameCount, 0);
+    }
+
+    /*
+     Recalculates the biquad coefficients if the cutoff, resonance or type
+     changed, and moves the state to another precision if the new cutoff
+     calls for it.
+     */
+    void prepareDirectForm(float frequency) {
+        PARAM_ITEM_FILTER_TYPE lclFilterType = PARAM_ITEM_FILTER_TYPE(filterType);
+        PARAM_ITEM_FILTER_PRECISION form = directFormPrecision(frequency);
+        if (frequency == dfCutoff && controlResonance == dfResonance && lclFilterType == dfFilterType && form == dfPrecision) {
+            return;
+        }
+
+        PreciseBiquadCoefficients precise;
+        precise.calculateCoefficients(frequency, controlResonance, lclFilterType, sampleRate);
+        if (form != dfPrecision) {
+            switchDirectFormPrecision(form, precise);
+        }
+
+        switch (form) {
+            case PARAM_ITEM_FILTER_PRECISION_ERROR_FEEDBACK:
+                efCoeffs.assign(precise);
+                break;
+            case PARAM_ITEM_FILTER_PRECISION_DOUBLE:
+                preciseCoeffs = precise;
+                break;
+            default:
+                coeffs.assign(precise);
+                break;
+        }
+        dfCutoff = frequency;
+        dfResonance = controlResonance;
+        dfFilterType = lclFilterType;
+    }
+
+    void processDirectForm(int firstChannel, int endChannel, AUAudioFrameCount frameCount, AUAudioFrameCount bufferOffset) {
+        switch (dfPrecision) {
+            case PARAM_ITEM_FILTER_PRECISION_ERROR_FEEDBACK:
+                errorFeedbackKernel(efCoeffs, errorFeedbackStates.begin(), inBufferListPtr, outBufferListPtr,
+                                    firstChannel, endChannel, frameCount, bufferOffset);
+                break;
+            case PARAM_ITEM_FILTER_PRECISION_DOUBLE:
+                doublePrecisionKernel(preciseCoeffs, doubleStates.begin(), inBufferListPtr, outBufferListPtr,
+                                      firstChannel, endChannel, frameCount, bufferOffset);
+                break;
+            default:
+                directFormKernel(coeffs, channelStates.begin(), inBufferListPtr, outBufferListPtr,
+                                 firstChannel, endChannel, frameCount, bufferOffset);
+                break;
+        }
+    }
+
+    // MARK: Precision
+
+    /*
+     How the biquad topology keeps its accuracy; see PreciseBiquad.hpp.
+     Automatic runs float Direct Form I until the cutoff falls below
+     errorFeedbackEntryFrequency of the sample rate (about 440 Hz at 44.1 kHz,
+     1.9 kHz at 192 kHz), where its noise rises above -100 dB, and error
+     feedback from there down. Double is only ever used when asked for. May
+     be changed at any time; the state carries over. Also the
+     FilterParamPrecision parameter, so it's saved and recorded with the rest.
+     */
+    void setPrecision(NSInteger inPrecision) {
+        precision = inPrecision;
+    }
+
+    NSInteger getPrecision() const {
+        return precision;
+    }
+
+    // The form in use: single, error feedback or double.
+    PARAM_ITEM_FILTER_PRECISION activePrecision() const {
+        return dfPrecision;
+    }
+
+    PARAM_ITEM_FILTER_PRECISION directFormPrecision(float frequency) const {
+        switch (PARAM_ITEM_FILTER_PRECISION(precision)) {
+            case PARAM_ITEM_FILTER_PRECISION_SINGLE:
+            case PARAM_ITEM_FILTER_PRECISION_ERROR_FEEDBACK:
+            case PARAM_ITEM_FILTER_PRECISION_DOUBLE:
+                return PARAM_ITEM_FILTER_PRECISION(precision);
+            default:
+                break;
+        }
+        // A little hysteresis, so a cutoff hovering at the boundary doesn't flip back and forth.
+        float normalizedFrequency = frequency * inverseSampleRate;
+        float boundary = dfPrecision == PARAM_ITEM_FILTER_PRECISION_ERROR_FEEDBACK
+                       ? errorFeedbackExitFrequency
+                       : errorFeedbackEntryFrequency;
+        return normalizedFrequency < boundary
+             ? PARAM_ITEM_FILTER_PRECISION_ERROR_FEEDBACK
+             : PARAM_ITEM_FILTER_PRECISION_SINGLE;
+    }
+
+    // Automatic's choice for a cutoff that holds still, without the hysteresis. Offline renders use it.
+    PARAM_ITEM_FILTER_PRECISION steadyDirectFormPrecision(float frequency, double atSampleRate) const {
+        switch (PARAM_ITEM_FILTER_PRECISION(precision)) {
+            case PARAM_ITEM_FILTER_PRECISION_SINGLE:
+            case PARAM_ITEM_FILTER_PRECISION_ERROR_FEEDBACK:
+            case PARAM_ITEM_FILTER_PRECISION_DOUBLE:
+                return PARAM_ITEM_FILTER_PRECISION(precision);
+            default:
+                break;
+        }
+        return double(frequency) / atSampleRate < double(errorFeedbackEntryFrequency)
+             ? PARAM_ITEM_FILTER_PRECISION_ERROR_FEEDBACK
+             : PARAM_ITEM_FILTER_PRECISION_SINGLE;
+    }
+
+    // Render thread. Carries every channel's ringing over to the new form.
+    void switchDirectFormPrecision(PARAM_ITEM_FILTER_PRECISION form, const PreciseBiquadCoefficients& precise) {
+        ErrorFeedbackBiquadCoefficients newErrorFeedback;
+        newErrorFeedback.assign(precise);
+        int channelCount = channelStates.size();
+        for (int channel = 0; channel < channelCount; ++channel) {
+            double r0 = 0.0;
+            double r1 = 0.0;
+            switch (dfPrecision) {
+                case PARAM_ITEM_FILTER_PRECISION_ERROR_FEEDBACK:
+                    errorFeedbackRinging(errorFeedbackStates[channel], efCoeffs, r0, r1);
+                    break;
+                case PARAM_ITEM_FILTER_PRECISION_DOUBLE:
+                    directFormRinging(doubleStates[channel], preciseCoeffs, r0, r1);
+                    break;
+                default:
+                    directFormRinging(channelStates[channel], coeffs, r0, r1);
+                    break;
+            }
+            switch (form) {
+                case PARAM_ITEM_FILTER_PRECISION_ERROR_FEEDBACK:
+                    setErrorFeedbackRinging(errorFeedbackStates[channel], newErrorFeedback, r0, r1);
+                    break;
+                case PARAM_ITEM_FILTER_PRECISION_DOUBLE:
+                    setDirectFormRinging(doubleStates[channel], precise, r0, r1);
+                    break;
+                default:
+                    setDirectFormRinging(channelStates[channel], precise, r0, r1);
+                    break;
+            }
+        }
+        dfPrecision = form;
+    }
+
+    /*
+     The state-variable path. Its responses are identical to the biquad's (both
+     are prewarped bilinear transforms of the same prototypes), so the response
+     API needs no changes. When the cutoff is being modulated, g glides linearly
+     to its new value across the period: a table lookup per period and a
+     divide per sample.
+     */
+    void prepareStateVariable(AUAudioFrameCount frameCount, float frequency, bool glide) {
+        PARAM_ITEM_FILTER_TYPE lclFilterType = PARAM_ITEM_FILTER_TYPE(filterType);
+        if (controlResonance != svfResonance || lclFilterType != svfFilterType) {
+            svfCoeffs.setResponse(controlResonance, lclFilterType);
+            svfCoeffs.setCutoff(svfG);
+            svfResonance = controlResonance;
+            svfFilterType = lclFilterType;
+        }
+
+        float targetG = tanTable.lookup(frequency * inverseSampleRate);
+
+        svfGliding = false;
+        if (!glide || targetG == svfG || svfG < 0.0f) {
+            if (targetG != svfG) {
+                svfG = targetG;
+                svfCoeffs.setCutoff(svfG);
+            }
+        }
+        else {
+            svfGlideStep = (targetG - svfG) / float(frameCount);
+            svfGliding = true;
+        }
+        svfTargetG = targetG;
+    }
+
+    void processStateVariable(int firstChannel, int endChannel, AUAudioFrameCount frameCount, AUAudioFrameCount bufferOffset) {
+        if (!svfGliding) {
+            stateVariableKernel(svfCoeffs, svfStates.begin(), inBufferListPtr, outBufferListPtr,
+                                firstChannel, endChannel, frameCount, bufferOffset);
+            return;
+        }
+
+        // Each channel group glides its own copy, so groups can run concurrently.
+        StateVariableFilterCoefficients c = svfCoeffs;
+        float g = svfG;
+
+        for (AUAudioFrameCount frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
+            g += svfGlideStep;
+            c.setCutoff(g);
 
             int frameOffset = int(frameIndex + bufferOffset);
 
-            for (int channel = 0; channel < channelCount; ++channel) {
-                FilterState& state = channelStates[channel];
+            for (int channel = firstChannel; channel < endChannel; ++channel) {
                 float* in  = (float*)inBufferListPtr->mBuffers[channel].mData  + frameOffset;
                 float* out = (float*)outBufferListPtr->mBuffers[channel].mData + frameOffset;
 
-                float x0 = *in;
-                float y0 = (coeffs.b0 * x0) + (coeffs.b1 * state.x1) + (coeffs.b2 * state.x2) - (coeffs.a1 * state.y1) - (coeffs.a2 * state.y2);
-                *out = y0;
+                *out = c.process(svfStates[channel], *in);
+            }
+        }
+
+        for (int channel = firstChannel; channel < endChannel; ++channel) {
+            svfStates[channel].convertBadStateValuesToZero();
+        }
+    }
+
+    void finishStateVariable() {
+        if (svfGliding) {
+            // Land exactly on the target despite rounding in the steps.
+            svfG = svfTargetG;
+            svfCoeffs.setCutoff(svfG);
+            svfGliding = false;
+        }
+    }
+
+    // MARK: Parallel rendering
+
+    /*
+     Spawns workers that share each period's channels with the render thread,
+     then measures where sharing starts to pay (see parallelMinimumSamples).
+     Off by default; only very wide formats gain from it. Not real-time safe:
+     call when allocating render resources, after init() and any
+     calibrateKernelVariant().
+     */
+    void startRenderWorkers(int workerCount, AUAudioFrameCount maximumFrames) {
+        workerPool.start(workerCount, sampleRate, maximumFrames);
+        parallelMinimumSamples = workerPool.workerCount() > 0 ? measureParallelMinimumSamples() : 0;
+    }
+
+    void stopRenderWorkers() {
+        workerPool.stop();
+    }
+
+    int renderWorkerCount() const {
+        return workerPool.workerCount();
+    }
+
+#if RENDER_WORKER_POOL_WORKGROUPS
+    // Render thread, from the host's render context observer; null leaves the last one.
+    void setRenderWorkgroup(os_workgroup_t workgroup) {
+        workerPool.setWorkgroup(workgroup);
+    }
+#endif
+
+    AUAudioFrameCount parallelRenderThreshold() const {
+        return parallelMinimumSamples;
+    }
+
+    /*
+     Splitting a period saves the share of its work the workers take,
+     (1 - 1/threads) of channels x frames x the cost of one channel-frame,
+     and costs one handoff. Both are timed here, on this machine with the
+     kernel variant in use, and the threshold is where they break even.
+     */
+    AUAudioFrameCount measureParallelMinimumSamples() {
+        int channelCount = channelStates.size();
+        if (channelCount == 0) {
+            return 0;
+        }
+        const AUAudioFrameCount frameCount = 256;
+        ScratchBuffers scratch(channelCount, frameCount);
 
-                state.x2 = state.x1;
-                state.x1 = x0;
-                state.y2 = state.y1;
-                state.y1 = y0;
+        KernelBiquadCoefficients dfCoefficients;
+        dfCoefficients.calculateCoefficients(1000.0, 0.7, PARAM_ITEM_FILTER_TYPE_LOWPASS, sampleRate);
+        double best = HUGE_VAL;
+        for (int run = 0; run < 10; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            directFormKernel(dfCoefficients, scratch.dfStates.begin(), scratch.bufferList, scratch.bufferList,
+                             0, channelCount, frameCount, 0);
+            double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            if (run >= 2) {
+                best = std::min(best, elapsed);
             }
         }
+        double sampleNanoseconds = std::max(best / (double(channelCount) * frameCount), 0.01);
 
-        // Squelch any blowups once per cycle.
-        for (int channel = 0; channel < channelCount; ++channel) {
-            channelStates[channel].convertBadStateValuesToZero();
+        int threadCount = workerPool.workerCount() + 1;
+        double savedPerSample = sampleNanoseconds * (1.0 - 1.0 / threadCount);
+        double threshold = workerPool.measureHandoffNanoseconds() / savedPerSample;
+        return AUAudioFrameCount(std::min(std::max(threshold, 256.0), 1048576.0));
+    }
+
+    /*
+     Filters every channel for one period. Channels are independent, so with
+     workers running they are split into groups; a group is a whole number of
+     cache lines of both state stores, so no two threads write the same line.
+     Periods with too little work to pay for the handoff stay on the render
+     thread.
+     */
+    void renderChannels(AUAudioFrameCount frameCount, AUAudioFrameCount bufferOffset, bool stateVariable) {
+        int channelCount = channelStates.size();
+        int threadCount = workerPool.workerCount() + 1;
+
+        if (threadCount == 1
+            || channelCount <= channelGroupGranularity
+            || AUAudioFrameCount(channelCount) * frameCount < parallelMinimumSamples) {
+            renderChannelRange(0, channelCount, frameCount, bufferOffset, stateVariable);
+            return;
         }
+
+        // Whole vectors too, or each group would end in the scalar loop.
+        int granularity = std::max(int(channelGroupGranularity), kernelVariantLanes(kernelVariant));
+        int groupSize = (channelCount + threadCount - 1) / threadCount;
+        groupSize = (groupSize + granularity - 1) / granularity * granularity;
+
+        renderJob.frameCount = frameCount;
+        renderJob.bufferOffset = bufferOffset;
+        renderJob.stateVariable = stateVariable;
+        renderJob.groupSize = groupSize;
+        workerPool.run(&renderChannelGroup, this, (channelCount + groupSize - 1) / groupSize);
     }
-	
-	BiquadCoefficientsPOD &calculateCoefficients(float frequency, float resonance,
+
+    void renderChannelRange(int firstChannel, int endChannel,
+                            AUAudioFrameCount frameCount, AUAudioFrameCount bufferOffset, bool stateVariable) {
+        if (stateVariable) {
+            processStateVariable(firstChannel, endChannel, frameCount, bufferOffset);
+        }
+        else {
+            processDirectForm(firstChannel, endChannel, frameCount, bufferOffset);
+        }
+    }
+
+    static void renderChannelGroup(void* context, int group) {
+        FilterDSPKernel* kernel = static_cast<FilterDSPKernel*>(context);
+        const RenderJob& job = kernel->renderJob;
+        int firstChannel = group * job.groupSize;
+        int endChannel = std::min(firstChannel + job.groupSize, kernel->channelStates.size());
+        kernel->renderChannelRange(firstChannel, endChannel, job.frameCount, job.bufferOffset, job.stateVariable);
+    }
+
+    // MARK: Instruction set dispatch
+
+    /*
+     Forces a variant from KernelDispatch.hpp, or -1 to choose one by CPU
+     detection. Applied by the next init(); unsupported variants are ignored.
+     */
+    void setKernelVariantOverride(int variant) {
+        kernelVariantOverride = kernelVariantSupported(variant) ? variant : -1;
+    }
+
+    int activeKernelVariant() const {
+        return kernelVariant;
+    }
+
+    void selectKernelVariant(int variant) {
+        if (!kernelVariantSupported(variant)) {
+            variant = KernelVariantScalar;
+        }
+        kernelVariant = variant;
+        directFormKernel = DirectFormKernels::forVariant(variant);
+        errorFeedbackKernel = ErrorFeedbackKernels::forVariant(variant);
+        doublePrecisionKernel = DoublePrecisionKernels::forVariant(variant);
+        stateVariableKernel = StateVariableKernels::forVariant(variant);
+    }
+
+    /*
+     Times every supported variant on scratch buffers shaped like the current
+     channel count and frameCount, and keeps the fastest. Allocates and takes
+     a few milliseconds, so call it when allocating render resources, after
+     init(). Returns the chosen variant.
+     */
+    int calibrateKernelVariant(AUAudioFrameCount frameCount) {
+        int channelCount = channelStates.size();
+        frameCount = std::max(std::min(frameCount, AUAudioFrameCount(4096)), AUAudioFrameCount(1));
+        if (channelCount == 0) {
+            return kernelVariant;
+        }
+
+        ScratchBuffers scratch(channelCount, frameCount);
+
+        KernelBiquadCoefficients dfCoefficients;
+        dfCoefficients.calculateCoefficients(1000.0, 0.7, PARAM_ITEM_FILTER_TYPE_LOWPASS, sampleRate);
+        StateVariableFilterCoefficients svfCoefficients;
+        svfCoefficients.setResponse(0.7, PARAM_ITEM_FILTER_TYPE_LOWPASS);
+        svfCoefficients.setCutoff(tanTable.lookup(1000.0f * inverseSampleRate));
+
+        int fastest = KernelVariantScalar;
+        double fastestTime = HUGE_VAL;
+        for (int variant = 0; variant < KernelVariantCount; ++variant) {
+            if (!kernelVariantSupported(variant)) {
+                continue;
+            }
+            DirectFormKernels::Function directForm = DirectFormKernels::forVariant(variant);
+            StateVariableKernels::Function stateVariable = StateVariableKernels::forVariant(variant);
+
+            // Best of several runs, after a couple to warm the caches.
+            double best = HUGE_VAL;
+            for (int run = 0; run < 10; ++run) {
+                auto start = std::chrono::steady_clock::now();
+                directForm(dfCoefficients, scratch.dfStates.begin(), scratch.bufferList, scratch.bufferList,
+                           0, channelCount, frameCount, 0);
+                stateVariable(svfCoefficients, scratch.svfStates.begin(), scratch.bufferList, scratch.bufferList,
+                              0, channelCount, frameCount, 0);
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (run >= 2) {
+                    best = std::min(best, elapsed);
+                }
+            }
+            if (best < fastestTime) {
+                fastestTime = best;
+                fastest = variant;
+            }
+        }
+
+        selectKernelVariant(fastest);
+        return fastest;
+    }
+
+    // MARK: Auto filter
+
+    void setSidechainBuffers(const AudioBufferList* sidechainBufferList) {
+        sidechainBufferListPtr = sidechainBufferList;
+    }
+
+    bool wantsSidechain() const {
+        return autoFilterEnabled && autoFilterSidechain;
+    }
+
+    // The sidechain if it's wanted and connected, otherwise the main input.
+    const AudioBufferList* detectorBufferList() const {
+        if (autoFilterSidechain && sidechainBufferListPtr != nullptr) {
+            return sidechainBufferListPtr;
+        }
+        return inBufferListPtr;
+    }
+
+    // Once per control period while periodic: the envelope and the MIDI glides move on.
+    void updateControl(AUAudioFrameCount periodFrames, bool modulating) {
+        if (modulating) {
+            float envelope = envelopeFollower.update(periodFrames, sampleRate);
+            // Depth is in octaves per unit of envelope, so a full-scale peak moves the cutoff by depth octaves.
+            envelopeOctaves = autoFilterDepth * envelope;
+        }
+
+        if (isControlGliding()) {
+            if (periodFrames != smoothingFrames || controlSmoothing != smoothingMilliseconds || sampleRate != smoothingSampleRate) {
+                // Only recalculated when a setting changes; exp() is too costly per period.
+                smoothingCoefficient = controlSmoothing > 0.0f
+                                     ? std::exp(-float(periodFrames) / (controlSmoothing * 0.001f * sampleRate))
+                                     : 0.0f;
+                smoothingFrames = periodFrames;
+                smoothingMilliseconds = controlSmoothing;
+                smoothingSampleRate = sampleRate;
+            }
+            cutoffSmoother.step(smoothingCoefficient, glideToleranceOctaves);
+            pitchSmoother.step(smoothingCoefficient, glideToleranceOctaves);
+            resonanceSmoother.step(smoothingCoefficient, glideToleranceResonance);
+            controlResonance = resonanceSmoother.value();
+        }
+    }
+
+    // MARK: MIDI
+
+    /*
+     MIDI, on any channel, is applied at the frame it falls on without
+     splitting the buffer around it: process() ends a period there, and what
+     the event changes glides at control rate with a time constant of
+     controlSmoothing milliseconds. Mapped controllers move their parameter, note numbers
+     track the cutoff by keyTracking percent around middle C, and pitch bend
+     moves it by up to pitchBendRange semitones.
+     */
+    bool schedulesMIDIEvents() const override {
+        return true;
+    }
+
+    void scheduleMIDIEvent(AUMIDIEvent const& midiEvent, AUAudioFrameCount frameOffset) override {
+        if (scheduledMIDIEvents.push(midiEvent, frameOffset)) {
+            return;
+        }
+        /*
+         A full queue. Apply what's queued up to this event's frame, early but
+         in order, so that it has room and nothing jumps the queue; dropping
+         instead could lose a note off. Events arrive in time order, so that
+         empties it, but should one still not fit it's dropped and counted.
+         */
+        applyScheduledMIDIEvents(frameOffset);
+        if (!scheduledMIDIEvents.push(midiEvent, frameOffset)) {
+            droppedMIDIEvents.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /*
+     The parameters controllers have moved since the last call, one bit per
+     address. The render thread can't tell the parameter tree itself, so the
+     adapter's owner polls this and does.
+     */
+    uint32_t takeParametersMovedByControllers() {
+        return parametersMovedByControllers.exchange(0, std::memory_order_acquire);
+    }
+
+    // Events the queue had no room for; safe to read from any thread.
+    uint64_t droppedMIDIEventCount() const {
+        return droppedMIDIEvents.load(std::memory_order_relaxed);
+    }
+
+    // The DSPKernel path, for callers that don't schedule.
+    void handleMIDIEvent(AUMIDIEvent const& midiEvent) override {
+        scheduleMIDIEvent(midiEvent, 0);
+    }
+
+    void applyScheduledMIDIEvents(AUAudioFrameCount bufferOffset) {
+        while (!scheduledMIDIEvents.isEmpty() && scheduledMIDIEvents.front().frameOffset <= bufferOffset) {
+            applyMIDIEvent(scheduledMIDIEvents.front());
+            scheduledMIDIEvents.pop();
+        }
+    }
+
+    void applyMIDIEvent(const ScheduledMIDIEvents::Event& event) {
+        switch (event.status & 0xF0) {
+            case 0x80:
+                heldNotes.noteOff(event.data1);
+                trackHeldNote();
+                break;
+            case 0x90:
+                if (event.data2 > 0) {
+                    heldNotes.noteOn(event.data1);
+                }
+                else {
+                    heldNotes.noteOff(event.data1);
+                }
+                trackHeldNote();
+                break;
+            case 0xB0:
+                applyControlChange(event.data1, event.data2);
+                break;
+            case 0xE0:
+                pitchBend = float(int(event.data1 | (event.data2 << 7)) - 8192) / 8192.0f;
+                break;
+            default:
+                break;
+        }
+    }
+
+    void applyControlChange(int controller, int value) {
+        switch (controller) {
+            case 121:   // Reset all controllers
+                pitchBend = 0.0;
+                return;
+            case 123:   // All notes off
+                heldNotes.clear();
+                return;
+            default:
+                break;
+        }
+
+        int32_t address = controllerMap.route(controller);
+        if (address == MIDIControllerMap::unmapped) {
+            return;
+        }
+        AUValue parameterValue = valueForControllerPosition(address, float(value) / 127.0f);
+        setParameter(address, parameterValue);
+        parametersMovedByControllers.fetch_or(1u << address, std::memory_order_release);
+
+        // Glide to the new value instead of letting updateControlTargets() jump to it.
+        if (address == FilterParamCutoff) {
+            controlCutoff = cutoff;
+            glideTo(cutoffSmoother, log2f(std::max(cutoff, 1.0f)));
+        }
+        else if (address == FilterParamResonance) {
+            controlResonanceTarget = resonance;
+            glideTo(resonanceSmoother, resonance);
+        }
+    }
+
+    // Keeps tracking the last note after it's released, so a release tail doesn't jump.
+    void trackHeldNote() {
+        int note = heldNotes.current();
+        if (note >= 0) {
+            trackedNote = note;
+        }
+    }
+
+    // Where a controller at position (0...1) sets each parameter, matching the parameter tree's ranges.
+    static AUValue valueForControllerPosition(AUParameterAddress address, float position) {
+        switch (address) {
+            case FilterParamCutoff:
+                return 12.0f * powf(20000.0f / 12.0f, position);
+            case FilterParamResonance:
+                return 0.1f * powf(25.0f / 0.1f, position);
+            case FilterParamType:
+                return roundf(position * float(PARAM_ITEM_FILTER_TYPE_PEAKINGEQ));
+            case FilterParamTopology:
+                return roundf(position * float(PARAM_ITEM_FILTER_TOPOLOGY_SVF));
+            case FilterParamAutoFilter:
+            case FilterParamAutoFilterSidechain:
+                return position >= 0.5f ? 1.0f : 0.0f;
+            case FilterParamAutoFilterAttack:
+            case FilterParamAutoFilterRelease:
+                return 0.01f * powf(5000.0f / 0.01f, position);
+            case FilterParamAutoFilterDepth:
+                return -8.0f + 16.0f * position;
+            case FilterParamControlInterval:
+                return roundf(powf(4096.0f, position));
+            case FilterParamKeyTracking:
+                return 100.0f * position;
+            case FilterParamPitchBendRange:
+                return roundf(48.0f * position);
+            case FilterParamControlSmoothing:
+                return 1000.0f * position;
+            case FilterParamPrecision:
+                return roundf(position * float(PARAM_ITEM_FILTER_PRECISION_DOUBLE));
+            default:
+                return position;
+        }
+    }
+
+    /*
+     Brings the smoothers' targets up to date. Parameters the host or the UI
+     set jump straight there, as they always have; MIDI's changes glide.
+     */
+    void updateControlTargets() {
+        if (cutoff != controlCutoff) {
+            controlCutoff = cutoff;
+            cutoffSmoother.jump(log2f(std::max(cutoff, 1.0f)));
+        }
+        if (resonance != controlResonanceTarget) {
+            controlResonanceTarget = resonance;
+            resonanceSmoother.jump(resonance);
+            controlResonance = resonance;
+        }
+
+        float pitchOctaves = (0.01f * keyTracking * float(trackedNote - 60) + pitchBend * pitchBendRange) / 12.0f;
+        if (pitchOctaves != pitchSmoother.target()) {
+            glideTo(pitchSmoother, pitchOctaves);
+        }
+    }
+
+    void glideTo(ControlSmoother& smoother, float value) {
+        if (controlSmoothing > 0.0f) {
+            smoother.glide(value);
+        }
+        else {
+            smoother.jump(value);
+        }
+    }
+
+    bool isControlGliding() const {
+        return cutoffSmoother.isGliding() || pitchSmoother.isGliding() || resonanceSmoother.isGliding();
+    }
+
+    // The cutoff for this period, with MIDI and the auto filter applied.
+    float controlFrequency() const {
+        // A settled smoother reads back cutoff itself, untouched by the log round trip.
+        float frequency = cutoffSmoother.isGliding() ? exp2f(cutoffSmoother.value()) : cutoff;
+        float octaves = pitchSmoother.value() + envelopeOctaves;
+        if (octaves == 0.0f && !autoFilterActive) {
+            return frequency;
+        }
+        return clamp(frequency * exp2f(octaves), 12.0f, 0.49f * sampleRate);
+    }
+
+		BiquadCoefficientsPOD &calculateCoefficients(float frequency, float resonance,
 											  PARAM_ITEM_FILTER_TYPE filterType)
 	{
 		// FIXME move this -- calc for  conversion of q to dbGain
@@ -398,16 +1161,125 @@ public:
     // MARK: Member Variables
 
 private:
-    std::vector<FilterState> channelStates;
+    AlignedStateStore<FilterState> channelStates;
     KernelBiquadCoefficients coeffs;
+    float dfCutoff = -1.0;
+    AUValue dfResonance = 0.0;
+    PARAM_ITEM_FILTER_TYPE dfFilterType = PARAM_ITEM_FILTER_TYPE_PASSTHROUGH;
+
+    // The biquad's other precisions; only the store for dfPrecision is live.
+    AlignedStateStore<ErrorFeedbackFilterState> errorFeedbackStates;
+    ErrorFeedbackBiquadCoefficients efCoeffs;
+    AlignedStateStore<DoubleFilterState> doubleStates;
+    PreciseBiquadCoefficients preciseCoeffs;
+    PARAM_ITEM_FILTER_PRECISION dfPrecision = PARAM_ITEM_FILTER_PRECISION_SINGLE;
+    NSInteger precision = PARAM_ITEM_FILTER_PRECISION_AUTOMATIC;
+
+    // Cutoff / sample rate below which Automatic switches to error feedback, and above which it switches back.
+    static constexpr float errorFeedbackEntryFrequency = 0.01f;
+    static constexpr float errorFeedbackExitFrequency = 0.0125f;
+
+    AlignedStateStore<StateVariableFilterState> svfStates;
+    StateVariableFilterCoefficients svfCoeffs;
+    TanTable tanTable;
+    float svfG = -1.0;
+    float svfTargetG = 0.0;
+    float svfGlideStep = 0.0;
+    bool svfGliding = false;
+    AUValue svfResonance = 0.0;
+    PARAM_ITEM_FILTER_TYPE svfFilterType = PARAM_ITEM_FILTER_TYPE_PASSTHROUGH;
+    NSUInteger activeTopology = PARAM_ITEM_FILTER_TOPOLOGY_BIQUAD;
 
     float sampleRate = 44100.0;
+    float inverseSampleRate = 1.0 / sampleRate;
     float nyquist = 0.5 * sampleRate;
     float inverseNyquist = 1.0 / nyquist;
     AUAudioFrameCount dezipperRampDuration;
 
     AudioBufferList* inBufferListPtr = nullptr;
     AudioBufferList* outBufferListPtr = nullptr;
+    const AudioBufferList* sidechainBufferListPtr = nullptr;
+
+    // The period renderChannels() is sharing out.
+    struct RenderJob {
+        AUAudioFrameCount frameCount = 0;
+        AUAudioFrameCount bufferOffset = 0;
+        bool stateVariable = false;
+        int groupSize = 0;
+    };
+
+    static constexpr int channelGroupGranularity =
+        AlignedStateStore<FilterState>::statesPerCacheLine > AlignedStateStore<StateVariableFilterState>::statesPerCacheLine
+        ? AlignedStateStore<FilterState>::statesPerCacheLine
+        : AlignedStateStore<StateVariableFilterState>::statesPerCacheLine;
+    // Channel-frames per period below which the handoff costs more than it saves.
+    AUAudioFrameCount parallelMinimumSamples = 0;
+
+    // Noise and zeroed states for timing the kernels off the render path.
+    struct ScratchBuffers {
+        ScratchBuffers(int channelCount, AUAudioFrameCount frameCount)
+            : samples(size_t(channelCount) * frameCount),
+              bufferListStorage(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * channelCount) {
+            unsigned int seed = 1;
+            for (float& sample : samples) {
+                seed = seed * 1664525u + 1013904223u;
+                sample = float(seed >> 8) * (1.0f / 16777216.0f) - 0.5f;
+            }
+            bufferList = reinterpret_cast<AudioBufferList*>(bufferListStorage.data());
+            bufferList->mNumberBuffers = channelCount;
+            for (int channel = 0; channel < channelCount; ++channel) {
+                bufferList->mBuffers[channel].mNumberChannels = 1;
+                bufferList->mBuffers[channel].mDataByteSize = UInt32(frameCount * sizeof(float));
+                bufferList->mBuffers[channel].mData = &samples[size_t(channel) * frameCount];
+            }
+            dfStates.allocate(channelCount);
+            dfStates.setCount(channelCount);
+            svfStates.allocate(channelCount);
+            svfStates.setCount(channelCount);
+        }
+
+        std::vector<float> samples;
+        std::vector<char> bufferListStorage;
+        AudioBufferList* bufferList;
+        AlignedStateStore<FilterState> dfStates;
+        AlignedStateStore<StateVariableFilterState> svfStates;
+    };
+
+    RenderWorkerPool workerPool;
+    RenderJob renderJob;
+
+    int kernelVariant = KernelVariantScalar;
+    int kernelVariantOverride = -1;
+    DirectFormKernels::Function directFormKernel = &DirectFormKernels::scalar;
+    ErrorFeedbackKernels::Function errorFeedbackKernel = &ErrorFeedbackKernels::scalar;
+    DoublePrecisionKernels::Function doublePrecisionKernel = &DoublePrecisionKernels::scalar;
+    StateVariableKernels::Function stateVariableKernel = &StateVariableKernels::scalar;
+
+    EnvelopeFollower envelopeFollower;
+    bool autoFilterActive = false;
+    float envelopeOctaves = 0.0;
+    AUAudioFrameCount controlPhase = 0;
+
+    // MIDI control. The cutoff and pitch offset glide in octaves.
+    ScheduledMIDIEvents scheduledMIDIEvents;
+    std::atomic<uint64_t> droppedMIDIEvents { 0 };
+    static_assert(FilterParamCount <= 32, "parametersMovedByControllers has a bit per address");
+    std::atomic<uint32_t> parametersMovedByControllers { 0 };
+    HeldNotes heldNotes;
+    int trackedNote = 60;
+    float pitchBend = 0.0;      // -1...1
+    ControlSmoother cutoffSmoother;
+    ControlSmoother pitchSmoother;
+    ControlSmoother resonanceSmoother;
+    AUValue controlCutoff = -1.0;
+    AUValue controlResonanceTarget = -1.0;
+    AUValue controlResonance = 0.0;
+    float smoothingCoefficient = 0.0;
+    AUAudioFrameCount smoothingFrames = 0;
+    float smoothingMilliseconds = -1.0;
+    float smoothingSampleRate = 0.0;
+    static constexpr float glideToleranceOctaves = 0.0005f;
+    static constexpr float glideToleranceResonance = 0.001f;
 	
 	BiquadCoefficientCalculator bqcCalculator;
 	KernelBiquadCoefficients coefficients = { 0 };
@@ -415,6 +1287,10 @@ private:
     bool bypassed = false;
 
 public:
+    // Read by the UI through the adapter.
+    MeteringTap meteringTap;
+    // Edited by the UI through the adapter while the render thread reads it.
+    MIDIControllerMap controllerMap;
 
     // Parameters.
 //    ParameterRamper cutoffRamper;
@@ -422,6 +1298,18 @@ public:
 	AUValue cutoff;
 	AUValue resonance;
 	NSUInteger filterType;
+	NSUInteger topology = PARAM_ITEM_FILTER_TOPOLOGY_BIQUAD;
+
+	// Auto filter: an envelope follower moves the cutoff once per control interval.
+	bool autoFilterEnabled = false;
+	bool autoFilterSidechain = false;
+	AUValue autoFilterDepth = 4.0;		// octaves at full scale
+	AUAudioFrameCount controlInterval = 32;
+
+	// MIDI control; see scheduleMIDIEvent().
+	AUValue keyTracking = 0.0;			// percent of the note's pitch
+	AUValue pitchBendRange = 12.0;		// semitones each way
+	AUValue controlSmoothing = 20.0;	// milliseconds
 };
 
 #endif /* FilterDSPKernel_hpp */
@@ -16,6 +16,12 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic) AUAudioFrameCount maximumFramesToRender;
 @property (nonatomic, readonly) AUAudioUnitBus *inputBus;
 @property (nonatomic, readonly) AUAudioUnitBus *outputBus;
+// Optional detector input for the auto filter.
+@property (nonatomic, readonly) AUAudioUnitBus *sidechainBus;
+// Parallel channel rendering. Set before allocating render resources; 0 (the default) renders serially.
+@property (nonatomic) NSInteger renderWorkerCount;
+// The workers actually running, which may be fewer than requested on machines with few cores.
+@property (nonatomic, readonly) NSInteger activeRenderWorkerCount;
 
 - (void)setParameter:(AUParameter *)parameter value:(AUValue)value;
 - (AUValue)valueForParameter:(AUParameter *)parameter;
@@ -23,11 +29,125 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)allocateRenderResources;
 - (void)deallocateRenderResources;
 - (AUInternalRenderBlock)internalRenderBlock;
+// Hands the host's audio workgroup to the render workers. BiquadFilterAU returns this.
+- (AURenderContextObserver)renderContextObserver API_AVAILABLE(macos(11.0), ios(14.0));
 
 - (NSArray<NSNumber *> *)magnitudesForFrequencies:(NSArray<NSNumber *> *)frequencies;
 - (NSArray<NSNumber *> *)magnitudes;
 - (NSArray<NSNumber *> *)ramp;
 - (struct BiquadCoefficientsPOD)kernelCoefficients;
+// Doesn't touch the kernel, so it's safe to call from any thread.
+- (struct BiquadCoefficientsPOD)coefficientsForCutoff:(AUValue)cutoff
+                                            resonance:(AUValue)resonance
+                                           filterType:(NSInteger)filterType
+                                           sampleRate:(double)sampleRate;
+
+/*
+ Instruction set dispatch. The filter loops are built for several instruction
+ sets ("scalar", "sse2", "avx2", "avx512" on Intel, "scalar" and "neon" on
+ Apple silicon). By default the widest one the CPU supports and the channel
+ count can fill is used; calibration times each on the current format
+ instead. All of these take effect when render resources are next allocated.
+ */
+@property (nonatomic, copy, nullable) NSString *kernelVariantOverride;
+@property (nonatomic) BOOL calibratesKernelVariant;
+@property (nonatomic, readonly) NSString *kernelVariant;
+@property (nonatomic, readonly) NSArray<NSString *> *supportedKernelVariants;
+
+/*
+ Precision of the Direct Form topology, a PARAM_ITEM_FILTER_PRECISION.
+ Automatic switches to error feedback at low cutoffs, where single precision
+ gets noisy; see PreciseBiquad.hpp. Set it with the Precision parameter, so
+ the parameter tree, saved state and recorded sessions all carry it.
+ activePrecision is the form the render thread last used.
+ */
+@property (nonatomic, readonly) NSInteger precision;
+@property (nonatomic, readonly) NSInteger activePrecision;
+
+/*
+ MIDI control. Controllers 0-119 can each move one parameter, bound here or
+ by learning: after learnControllerForParameter, the next controller to
+ move is bound to that parameter. MIDI changes glide over the Smoothing
+ parameter and update at the Control Interval; key tracking and pitch bend
+ move the cutoff. Parameters a controller moves read back their new value;
+ takeParametersMovedByControllers says which have moved, so that their new
+ values can be set on the parameter tree for the host to see.
+ */
+- (void)mapController:(NSInteger)controller toParameter:(AUParameterAddress)address;
+- (void)unmapController:(NSInteger)controller;
+// The parameter address, or -1 if the controller isn't mapped.
+- (NSInteger)parameterForController:(NSInteger)controller;
+- (void)learnControllerForParameter:(AUParameterAddress)address;
+- (void)cancelControllerLearn;
+@property (nonatomic, readonly, getter=isLearningController) BOOL learningController;
+// The controller the last learn bound, or -1 while it's still waiting.
+@property (nonatomic, readonly) NSInteger lastLearnedController;
+// One bit per parameter address, cleared by the call. Any thread.
+- (uint32_t)takeParametersMovedByControllers;
+// MIDI events lost to a full schedule; see FilterDSPKernel::scheduleMIDIEvent.
+@property (nonatomic, readonly) NSInteger droppedMIDIEvents;
+// One entry per controller, -1 where unmapped; for saving with the preset.
+@property (nonatomic, copy) NSArray<NSNumber *> *controllerMap;
+
+/*
+ Offline rendering. Filters a whole file with the current cutoff, resonance
+ and type, split across every core. Chunks join within tolerance (relative to
+ the signal level) of a serial render; see ChunkedBiquadRenderer. Zero-phase
+ renders use the tolerance the same way for their block joins, on one thread.
+ Memory use doesn't depend on the file's length. Blocks until done, so call it off the
+ main thread.
+
+ The precision follows the Precision parameter as the kernel applies it to a
+ cutoff that holds still, at the file's sample rate; where that's error
+ feedback the render is in double, which is at least as accurate. It always
+ uses the Direct Form topology: with nothing moving, the state-variable
+ filter has the same response, and its advantage is in following a moving
+ cutoff, which an offline render doesn't have.
+ */
+// Frames each chunk settles for before its output is kept; 0 derives it from the filter's decay time.
+@property (nonatomic) AUAudioFrameCount offlinePreRollFrames;
+/*
+ Offline renders filter forward and then backward: no phase shift, and the
+ magnitude response squared. The response methods below report the squared
+ response while this is set. See ZeroPhaseBiquadRenderer.
+ */
+@property (nonatomic, getter=isZeroPhase) BOOL zeroPhase;
+
+- (BOOL)renderFileAtURL:(NSURL *)inputURL
+                  toURL:(NSURL *)outputURL
+              tolerance:(double)tolerance
+                  error:(NSError **)outError;
+
+/*
+ Session recording, for reproducing a host session outside the host. Logs
+ each render callback's timing, events and parameters, and optionally its
+ input, to url; Tools/RenderSessionReplay plays the file back through the
+ kernel. The render thread never waits on the disk: callbacks that arrive
+ faster than the file can take them are dropped and counted. Recording ends
+ with stopRecordingSession or when render resources are deallocated.
+ */
+@property (nonatomic, readonly) BOOL isRecordingSession;
+@property (nonatomic, readonly) NSInteger droppedSessionCallbacks;
+
+- (BOOL)startRecordingSessionToURL:(NSURL *)url
+                      includeAudio:(BOOL)includeAudio
+                             error:(NSError **)outError;
+// Returns NO if part of the file couldn't be written.
+- (BOOL)stopRecordingSession;
+
+// Metering tap. Leave it disabled unless something is reading from it.
+@property (nonatomic, getter=isMeteringEnabled) BOOL meteringEnabled;
+@property (nonatomic, readonly) double meteringSampleRate;
+@property (nonatomic, readonly) NSInteger meteringChannelCount;
+@property (nonatomic, readonly) double meteringCostMicroseconds;
+@property (nonatomic, readonly) double maximumMeteringCostMicroseconds;
+
+- (NSInteger)readMeteringInput:(float *)input output:(float *)output count:(NSInteger)count;
+// Output levels, after the filter; the input ones are from before it.
+- (AUValue)peakForChannel:(NSInteger)channel;
+- (AUValue)rmsForChannel:(NSInteger)channel;
+- (AUValue)inputPeakForChannel:(NSInteger)channel;
+- (AUValue)inputRMSForChannel:(NSInteger)channel;
 @end
 
 NS_ASSUME_NONNULL_END
@@ -9,32 +9,50 @@ The adapter object that provides a Swift-accessible interface to the filter's un
 #import <CoreAudioKit/AUViewController.h>
 #import "FilterDSPKernel.hpp"
 #import "BufferedAudioBus.hpp"
+#import "OfflineBiquadRenderer.hpp"
+#import "RenderSessionRecorder.hpp"
 #import "FilterDSPKernelAdapter.h"
 #import <BiquadFilterFramework/BiquadFilterFramework-Swift.h>
 
 #define MAGNITUDE_POINT_COUNT	256
+// Covers higher-order ambisonics and large multichannel beds.
+#define MAXIMUM_CHANNEL_COUNT	128
 
 @implementation FilterDSPKernelAdapter {
     // C++ members need to be ivars; they would be copied on access if they were properties.
     FilterDSPKernel  _kernel;
     BufferedInputBus _inputBus;
+    BufferedInputBus _sidechainBus;
+    RenderSessionRecorder _sessionRecorder;
 	BiquadCoefficientCalculator *_bqcCalculator;
 	MagnitudeResponseCalculator *mrc;
 }
 
+@synthesize renderWorkerCount = _renderWorkerCount;
+@synthesize offlinePreRollFrames = _offlinePreRollFrames;
+@synthesize zeroPhase = _zeroPhase;
+@synthesize kernelVariantOverride = _kernelVariantOverride;
+@synthesize calibratesKernelVariant = _calibratesKernelVariant;
+
 - (instancetype)init {
 
     if (self = [super init]) {
         AVAudioFormat *format = [[AVAudioFormat alloc] initStandardFormatWithSampleRate:44100 channels:2];
         // Create a DSP kernel to handle the signal processing.
+        // Size its channel state once, up front, for the widest bus format.
+        _kernel.allocateChannelStates(MAXIMUM_CHANNEL_COUNT);
+        _kernel.allocateMeteringTap(MAXIMUM_CHANNEL_COUNT, _kernel.maximumFramesToRender());
         _kernel.init(format.channelCount, format.sampleRate);
         _kernel.setParameter(FilterParamCutoff, 0);
         _kernel.setParameter(FilterParamResonance, 0);
 		_kernel.setParameter(FilterParamType, 0);
 
         // Create the input and output busses.
-        _inputBus.init(format, 8);
+        _inputBus.init(format, MAXIMUM_CHANNEL_COUNT);
         _outputBus = [[AUAudioUnitBus alloc] initWithFormat:format error:nil];
+        _outputBus.maximumChannelCount = MAXIMUM_CHANNEL_COUNT;
+        _sidechainBus.init(format, MAXIMUM_CHANNEL_COUNT);
+        _sidechainBus.bus.name = @"Sidechain";
 		
 		_bqcCalculator = new BiquadCoefficientCalculator();
     }
@@ -49,6 +67,10 @@ The adapter object that provides a Swift-accessible interface to the filter's un
     return _inputBus.bus;
 }
 
+- (AUAudioUnitBus *)sidechainBus {
+    return _sidechainBus.bus;
+}
+
 - (NSArray<NSNumber *> *)magnitudesForFrequencies:(NSArray<NSNumber *> *)frequencies {
 	BiquadCoefficientsPOD coefficients;
 	BiquadInputs inputs;
@@ -74,6 +96,10 @@ The adapter object that provides a Swift-accessible interface to the filter's un
     for (NSNumber *number in frequencies) {
         double frequency = [number doubleValue];
         double magnitude = _kernel.magnitudeForFrequency(frequency * inverseNyquist);
+        if (self.zeroPhase) {
+            // The forward and backward passes each apply the response once.
+            magnitude *= magnitude;
+        }
 
         [magnitudes addObject:@(magnitude)];
     }
@@ -106,7 +132,16 @@ The adapter object that provides a Swift-accessible interface to the filter's un
 	cpod.b1 = coeffs.b1;
 	cpod.b2 = coeffs.b2;
 	
-	return [mrc responseFor:cpod];
+	NSArray<NSNumber *> *response = [mrc responseFor:cpod];
+	if (!self.zeroPhase) {
+		return response;
+	}
+	NSMutableArray<NSNumber *> *squared = [NSMutableArray arrayWithCapacity:response.count];
+	for (NSNumber *number in response) {
+		float magnitude = number.floatValue;
+		[squared addObject:@(magnitude * magnitude)];
+	}
+	return squared;
 }
 
 - (struct BiquadCoefficientsPOD)kernelCoefficients {
@@ -122,6 +157,232 @@ The adapter object that provides a Swift-accessible interface to the filter's un
 	return cpod;
 }
 
+- (struct BiquadCoefficientsPOD)coefficientsForCutoff:(AUValue)cutoff
+                                            resonance:(AUValue)resonance
+                                           filterType:(NSInteger)filterType
+                                           sampleRate:(double)sampleRate {
+	// Same limits as FilterDSPKernel::setParameter.
+	BiquadCoefficientCalculator calculator;
+	BiquadCoefficientsPOD cpod;
+	return calculator.calculate(cpod,
+								clamp(cutoff, 0.0f, 20000.0f),
+								clamp(resonance, 0.1f, 25.0f),
+								PARAM_ITEM_FILTER_TYPE(filterType),
+								sampleRate);
+}
+
+#pragma mark - Offline rendering
+
+- (BOOL)renderFileAtURL:(NSURL *)inputURL
+                  toURL:(NSURL *)outputURL
+              tolerance:(double)tolerance
+                  error:(NSError **)outError {
+	AVAudioFile *inputFile = [[AVAudioFile alloc] initForReading:inputURL
+	                                                 commonFormat:AVAudioPCMFormatFloat32
+	                                                  interleaved:NO
+	                                                        error:outError];
+	if (inputFile == nil) {
+		return NO;
+	}
+	AVAudioFormat *format = inputFile.processingFormat;
+
+	AVAudioFile *outputFile = [[AVAudioFile alloc] initForWriting:outputURL
+	                                                     settings:inputFile.fileFormat.settings
+	                                                 commonFormat:AVAudioPCMFormatFloat32
+	                                                  interleaved:NO
+	                                                        error:outError];
+	if (outputFile == nil) {
+		return NO;
+	}
+
+	// Snapshot the parameters; the file is rendered with the filter as it is now,
+	// in the precision the kernel would settle on for this cutoff at the file's rate.
+	OfflineBiquadCoefficients coefficients;
+	coefficients.calculateCoefficients(_kernel.cutoff,
+									   _kernel.resonance,
+									   PARAM_ITEM_FILTER_TYPE(_kernel.filterType),
+									   format.sampleRate,
+									   _kernel.steadyDirectFormPrecision(_kernel.cutoff, format.sampleRate));
+
+	if (self.zeroPhase) {
+		return [self renderZeroPhaseFile:inputFile
+								  toFile:outputFile
+							coefficients:coefficients
+							   tolerance:tolerance
+								   error:outError];
+	}
+
+	ChunkedBiquadRenderer renderer;
+	renderer.setCoefficients(coefficients, int(format.channelCount));
+	renderer.setTolerance(tolerance);
+	renderer.setPreRollFrames(self.offlinePreRollFrames);
+
+	// Only this much of the file is ever in memory.
+	AVAudioPCMBuffer *buffer = [[AVAudioPCMBuffer alloc] initWithPCMFormat:format
+	                                                          frameCapacity:renderer.preferredBlockFrames()];
+	while (inputFile.framePosition < inputFile.length) {
+		if (![inputFile readIntoBuffer:buffer error:outError]) {
+			return NO;
+		}
+		if (buffer.frameLength == 0) {
+			break;
+		}
+		renderer.process(buffer.floatChannelData, buffer.floatChannelData, buffer.frameLength);
+		if (![outputFile writeFromBuffer:buffer error:outError]) {
+			return NO;
+		}
+	}
+	return YES;
+}
+
+- (BOOL)renderZeroPhaseFile:(AVAudioFile *)inputFile
+					 toFile:(AVAudioFile *)outputFile
+			   coefficients:(const OfflineBiquadCoefficients &)coefficients
+				  tolerance:(double)tolerance
+					  error:(NSError **)outError {
+	AVAudioFormat *format = inputFile.processingFormat;
+	const UInt32 channelCount = format.channelCount;
+
+	ZeroPhaseBiquadRenderer renderer;
+	renderer.setCoefficients(coefficients, int(channelCount));
+	renderer.setTolerance(tolerance);
+
+	const AVAudioFrameCount bufferFrames = 1 << 16;
+	AVAudioPCMBuffer *readBuffer = [[AVAudioPCMBuffer alloc] initWithPCMFormat:format frameCapacity:bufferFrames];
+	AVAudioPCMBuffer *writeBuffer = [[AVAudioPCMBuffer alloc] initWithPCMFormat:format frameCapacity:bufferFrames];
+	NSError *error = nil;
+
+	bool rendered = renderer.render(
+		[&](float* const* buffers, AUAudioFrameCount maximumFrames, AUAudioFrameCount& frames) {
+			frames = 0;
+			if (inputFile.framePosition >= inputFile.length) {
+				return true;
+			}
+			readBuffer.frameLength = 0;
+			NSError *readError = nil;
+			if (![inputFile readIntoBuffer:readBuffer frameCount:std::min(maximumFrames, bufferFrames) error:&readError]) {
+				error = readError;
+				return false;
+			}
+			frames = readBuffer.frameLength;
+			for (UInt32 channel = 0; channel < channelCount; ++channel) {
+				memcpy(buffers[channel], readBuffer.floatChannelData[channel], frames * sizeof(float));
+			}
+			return true;
+		},
+		[&](const float* const* buffers, AUAudioFrameCount frames) {
+			for (AUAudioFrameCount done = 0; done < frames;) {
+				AUAudioFrameCount chunk = std::min(frames - done, bufferFrames);
+				for (UInt32 channel = 0; channel < channelCount; ++channel) {
+					memcpy(writeBuffer.floatChannelData[channel], buffers[channel] + done, chunk * sizeof(float));
+				}
+				writeBuffer.frameLength = chunk;
+				NSError *writeError = nil;
+				if (![outputFile writeFromBuffer:writeBuffer error:&writeError]) {
+					error = writeError;
+					return false;
+				}
+				done += chunk;
+			}
+			return true;
+		});
+
+	if (!rendered && outError != nullptr) {
+		*outError = error;
+	}
+	return rendered;
+}
+
+#pragma mark - Session recording
+
+- (BOOL)startRecordingSessionToURL:(NSURL *)url includeAudio:(BOOL)includeAudio error:(NSError **)outError {
+	if (!_sessionRecorder.start(url.fileSystemRepresentation,
+								self.outputBus.format.sampleRate,
+								int(self.outputBus.format.channelCount),
+								self.maximumFramesToRender,
+								FilterParamCount,
+								MIDIControllerMap::controllerCount + 1,
+								includeAudio)) {
+		if (outError != nullptr) {
+			*outError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+		}
+		return NO;
+	}
+	return YES;
+}
+
+- (BOOL)stopRecordingSession {
+	return _sessionRecorder.stop();
+}
+
+- (BOOL)isRecordingSession {
+	return _sessionRecorder.isRecording();
+}
+
+- (NSInteger)droppedSessionCallbacks {
+	return NSInteger(_sessionRecorder.droppedCallbacks());
+}
+
+#pragma mark - Metering
+
+- (BOOL)isMeteringEnabled {
+    return _kernel.meteringTap.isEnabled();
+}
+
+- (void)setMeteringEnabled:(BOOL)meteringEnabled {
+    _kernel.meteringTap.setEnabled(meteringEnabled);
+}
+
+- (double)meteringSampleRate {
+    return _kernel.meteringTap.tapSampleRate();
+}
+
+- (NSInteger)meteringChannelCount {
+    return std::min(_kernel.meteringTap.channelCount(), int(self.outputBus.format.channelCount));
+}
+
+- (NSInteger)readMeteringInput:(float *)input output:(float *)output count:(NSInteger)count {
+    return NSInteger(_kernel.meteringTap.read(input, output, size_t(count)));
+}
+
+- (AUValue)peakForChannel:(NSInteger)channel {
+    if (channel < 0 || channel >= self.meteringChannelCount) {
+        return 0;
+    }
+    return _kernel.meteringTap.takePeak(int(channel));
+}
+
+- (AUValue)rmsForChannel:(NSInteger)channel {
+    if (channel < 0 || channel >= self.meteringChannelCount) {
+        return 0;
+    }
+    return _kernel.meteringTap.rms(int(channel));
+}
+
+- (AUValue)inputPeakForChannel:(NSInteger)channel {
+    if (channel < 0 || channel >= self.meteringChannelCount) {
+        return 0;
+    }
+    return _kernel.meteringTap.takeInputPeak(int(channel));
+}
+
+- (AUValue)inputRMSForChannel:(NSInteger)channel {
+    if (channel < 0 || channel >= self.meteringChannelCount) {
+        return 0;
+    }
+    return _kernel.meteringTap.inputRMS(int(channel));
+}
+
+- (double)meteringCostMicroseconds {
+    return double(_kernel.meteringTap.lastCostNanoseconds()) / 1000.0;
+}
+
+- (double)maximumMeteringCostMicroseconds {
+    return double(_kernel.meteringTap.maximumCostNanoseconds()) / 1000.0;
+}
+
+#pragma mark -
+
 - (void)setParameter:(AUParameter *)parameter value:(AUValue)value {
     _kernel.setParameter(parameter.address, value);
 }
@@ -138,6 +399,91 @@ The adapter object that provides a Swift-accessible interface to the filter's un
     _kernel.setMaximumFramesToRender(maximumFramesToRender);
 }
 
+- (NSString *)kernelVariant {
+    return @(kernelVariantName(_kernel.activeKernelVariant()));
+}
+
+- (NSArray<NSString *> *)supportedKernelVariants {
+    NSMutableArray<NSString *> *variants = [NSMutableArray array];
+    for (int variant = 0; variant < KernelVariantCount; ++variant) {
+        if (kernelVariantSupported(variant)) {
+            [variants addObject:@(kernelVariantName(variant))];
+        }
+    }
+    return variants;
+}
+
+- (NSInteger)precision {
+    return _kernel.getPrecision();
+}
+
+- (NSInteger)activePrecision {
+    return _kernel.activePrecision();
+}
+
+#pragma mark - MIDI control
+
+- (void)mapController:(NSInteger)controller toParameter:(AUParameterAddress)address {
+    if (address < FilterParamCount) {
+        _kernel.controllerMap.map(int(controller), int32_t(address));
+    }
+}
+
+- (void)unmapController:(NSInteger)controller {
+    _kernel.controllerMap.map(int(controller), MIDIControllerMap::unmapped);
+}
+
+- (NSInteger)parameterForController:(NSInteger)controller {
+    return _kernel.controllerMap.parameterForController(int(controller));
+}
+
+- (void)learnControllerForParameter:(AUParameterAddress)address {
+    if (address < FilterParamCount) {
+        _kernel.controllerMap.learn(int32_t(address));
+    }
+}
+
+- (void)cancelControllerLearn {
+    _kernel.controllerMap.cancelLearn();
+}
+
+- (BOOL)isLearningController {
+    return _kernel.controllerMap.isLearning();
+}
+
+- (NSInteger)lastLearnedController {
+    return _kernel.controllerMap.lastLearnedController();
+}
+
+- (uint32_t)takeParametersMovedByControllers {
+    return _kernel.takeParametersMovedByControllers();
+}
+
+- (NSInteger)droppedMIDIEvents {
+    return NSInteger(_kernel.droppedMIDIEventCount());
+}
+
+- (NSArray<NSNumber *> *)controllerMap {
+    NSMutableArray<NSNumber *> *map = [NSMutableArray arrayWithCapacity:MIDIControllerMap::controllerCount];
+    for (int controller = 0; controller < MIDIControllerMap::controllerCount; ++controller) {
+        [map addObject:@(_kernel.controllerMap.parameterForController(controller))];
+    }
+    return map;
+}
+
+- (void)setControllerMap:(NSArray<NSNumber *> *)controllerMap {
+    for (int controller = 0; controller < MIDIControllerMap::controllerCount; ++controller) {
+        NSInteger address = controller < NSInteger(controllerMap.count) ? controllerMap[controller].integerValue : -1;
+        _kernel.controllerMap.map(controller, address >= 0 && address < FilterParamCount ? int32_t(address) : MIDIControllerMap::unmapped);
+    }
+}
+
+#pragma mark -
+
+- (NSInteger)activeRenderWorkerCount {
+    return _kernel.renderWorkerCount();
+}
+
 - (BOOL)shouldBypassEffect {
     return _kernel.isBypassed();
 }
@@ -148,12 +494,28 @@ The adapter object that provides a Swift-accessible interface to the filter's un
 
 - (void)allocateRenderResources {
     _inputBus.allocateRenderResources(self.maximumFramesToRender);
+    _sidechainBus.allocateRenderResources(self.maximumFramesToRender);
+    // A no-op unless the format is wider than MAXIMUM_CHANNEL_COUNT.
+    _kernel.allocateChannelStates(self.outputBus.format.channelCount);
+    _kernel.allocateMeteringTap(self.outputBus.format.channelCount, self.maximumFramesToRender);
+    _kernel.setKernelVariantOverride(self.kernelVariantOverride != nil
+                                     ? kernelVariantForName(self.kernelVariantOverride.UTF8String)
+                                     : -1);
     _kernel.init(self.outputBus.format.channelCount, self.outputBus.format.sampleRate);
+    if (self.calibratesKernelVariant && self.kernelVariantOverride == nil) {
+        _kernel.calibrateKernelVariant(self.maximumFramesToRender);
+    }
     _kernel.reset();
+    // Spawns threads, so it has to happen here rather than in the render block.
+    _kernel.startRenderWorkers(int(self.renderWorkerCount), self.maximumFramesToRender);
 }
 
 - (void)deallocateRenderResources {
+    // The session's format ends here.
+    _sessionRecorder.stop();
+    _kernel.stopRenderWorkers();
     _inputBus.deallocateRenderResources();
+    _sidechainBus.deallocateRenderResources();
 }
 
 #pragma mark - AUAudioUnit (AUAudioUnitImplementation)
@@ -166,6 +528,8 @@ The adapter object that provides a Swift-accessible interface to the filter's un
     // Specify that captured objects are mutable.
     __block FilterDSPKernel *state = &_kernel;
     __block BufferedInputBus *input = &_inputBus;
+    __block BufferedInputBus *sidechain = &_sidechainBus;
+    __block RenderSessionRecorder *recorder = &_sessionRecorder;
 
     return ^AUAudioUnitStatus(AudioUnitRenderActionFlags *actionFlags,
                               const AudioTimeStamp       *timestamp,
@@ -205,7 +569,9 @@ The adapter object that provides a Swift-accessible interface to the filter's un
          */
 
         // If you receive null output buffer pointers, process them in-place in the
-        // input buffer.
+        // input buffer. This can't be prepared ahead like the input list: the
+        // pull may have replaced the input pointers, and the host hands over a
+        // fresh output list each call. It's one store per channel.
         AudioBufferList *outAudioBufferList = outputData;
         if (outAudioBufferList->mBuffers[0].mData == nullptr) {
             for (UInt32 i = 0; i < outAudioBufferList->mNumberBuffers; ++i) {
@@ -214,10 +580,69 @@ The adapter object that provides a Swift-accessible interface to the filter's un
         }
 
         state->setBuffers(inAudioBufferList, outAudioBufferList);
-        state->processWithEvents(timestamp, frameCount, realtimeEventListHead, nil /* MIDIOutEventBlock */);
+
+        // Only pull the sidechain when the auto filter listens to it. If the host
+        // hasn't connected it, the envelope follower falls back to the main input.
+        const AudioBufferList *sidechainAudioBufferList = nullptr;
+        if (state->wantsSidechain()) {
+            AudioUnitRenderActionFlags sidechainFlags = 0;
+            if (sidechain->pullInput(&sidechainFlags, timestamp, frameCount, 1, pullInputBlock) == noErr) {
+                sidechainAudioBufferList = sidechain->mutableAudioBufferList;
+            }
+        }
+        state->setSidechainBuffers(sidechainAudioBufferList);
+
+        if (recorder->isRecording()) {
+            AUValue parameters[FilterParamCount];
+            for (int address = 0; address < FilterParamCount; ++address) {
+                parameters[address] = state->getParameter(address);
+            }
+            int32_t controllers[MIDIControllerMap::controllerCount + 1];
+            for (int controller = 0; controller < MIDIControllerMap::controllerCount; ++controller) {
+                controllers[controller] = state->controllerMap.parameterForController(controller);
+            }
+            controllers[MIDIControllerMap::controllerCount] = state->controllerMap.learningParameter();
+            recorder->record(timestamp, frameCount, realtimeEventListHead,
+                             inAudioBufferList, sidechainAudioBufferList, state->isBypassed(), parameters, controllers);
+        }
+
+        // Capture the input before an in-place render overwrites it.
+        bool metered = state->meterInput(frameCount);
+        if (realtimeEventListHead == nullptr) {
+            state->processWithoutEvents(frameCount);
+        }
+        else {
+            state->processWithEvents(timestamp, frameCount, realtimeEventListHead, nil /* MIDIOutEventBlock */);
+        }
+        state->meterOutput(frameCount, metered);
 
         return noErr;
     };
 }
 
+// Called on the render thread whenever the context changes, before the render block.
+- (AURenderContextObserver)renderContextObserver {
+    __block FilterDSPKernel *state = &_kernel;
+
+    return ^(const AudioUnitRenderContext *context) {
+        state->setRenderWorkgroup(context != nullptr ? context->workgroup : nil);
+    };
+}
+
+@end
+
+/*
+ Swift can't override renderContextObserver, since its block runs on the
+ render thread, so the audio unit's override lives here.
+ */
+@interface BiquadFilterAU (RenderContextObserver)
+- (AURenderContextObserver)renderContextObserver API_AVAILABLE(macos(11.0), ios(14.0));
+@end
+
+@implementation BiquadFilterAU (RenderContextObserver)
+
+- (AURenderContextObserver)renderContextObserver {
+    return [self.renderingKernelAdapter renderContextObserver];
+}
+
 @end
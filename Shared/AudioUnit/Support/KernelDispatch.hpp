@@ -0,0 +1,591 @@
+//
+//  KernelDispatch.hpp
+//  BiquadFilter
+//
+//  Filter loops built for several instruction sets, and the CPU feature
+//  detection that chooses between them at run time.
+//
+
+#ifndef KernelDispatch_hpp
+#define KernelDispatch_hpp
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <algorithm>
+#import <cstdint>
+#import <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNEL_DISPATCH_X86 1
+#import <cpuid.h>
+#endif
+#if defined(__APPLE__)
+#import <sys/sysctl.h>
+#endif
+
+/*
+ The recursion makes each channel's samples depend on the previous ones, so
+ the vector loops run several channels side by side instead: lane n of every
+ vector belongs to channel n of the block. They only pay off once there are
+ at least as many channels as lanes; channels left over at the end of a range
+ go through the scalar loop.
+ */
+enum KernelVariant {
+    KernelVariantScalar = 0,
+    KernelVariantSSE2,      // 4 lanes; the x86-64 baseline
+    KernelVariantAVX2,      // 8 lanes, fused multiply-add
+    KernelVariantAVX512,    // 16 lanes
+    KernelVariantNEON,      // 4 lanes; the arm64 baseline
+    KernelVariantCount
+};
+
+static inline const char* kernelVariantName(int variant) {
+    switch (variant) {
+        case KernelVariantScalar: return "scalar";
+        case KernelVariantSSE2:   return "sse2";
+        case KernelVariantAVX2:   return "avx2";
+        case KernelVariantAVX512: return "avx512";
+        case KernelVariantNEON:   return "neon";
+        default:                  return "unknown";
+    }
+}
+
+// Returns -1 for names that don't match a variant.
+static inline int kernelVariantForName(const char* name) {
+    for (int variant = 0; variant < KernelVariantCount; ++variant) {
+        if (name != nullptr && std::strcmp(name, kernelVariantName(variant)) == 0) {
+            return variant;
+        }
+    }
+    return -1;
+}
+
+static inline int kernelVariantLanes(int variant) {
+    switch (variant) {
+        case KernelVariantSSE2:   return 4;
+        case KernelVariantAVX2:   return 8;
+        case KernelVariantAVX512: return 16;
+        case KernelVariantNEON:   return 4;
+        default:                  return 1;
+    }
+}
+
+// MARK: CPU features
+
+struct CPUFeatures {
+    bool sse2 = false;
+    bool avx2 = false;      // with FMA, and the OS saving YMM state
+    bool avx512f = false;   // with the OS saving ZMM state
+    bool neon = false;
+};
+
+#if defined(__APPLE__)
+static inline bool sysctlFlag(const char* name) {
+    int value = 0;
+    size_t size = sizeof(value);
+    return sysctlbyname(name, &value, &size, nullptr, 0) == 0 && value != 0;
+}
+#endif
+
+#if KERNEL_DISPATCH_X86
+static inline uint64_t readExtendedControlRegister() {
+    uint32_t eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (uint64_t(edx) << 32) | eax;
+}
+#endif
+
+static inline CPUFeatures detectCPUFeatures() {
+    CPUFeatures features;
+#if KERNEL_DISPATCH_X86
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return features;
+    }
+    features.sse2 = (edx & (1u << 26)) != 0;
+    bool fma = (ecx & (1u << 12)) != 0;
+    bool osxsave = (ecx & (1u << 27)) != 0;
+    bool avx = (ecx & (1u << 28)) != 0;
+
+    unsigned int leaf7ebx = 0;
+    if (__get_cpuid_count(7, 0, &eax, &leaf7ebx, &ecx, &edx) == 0) {
+        leaf7ebx = 0;
+    }
+    bool avx2 = (leaf7ebx & (1u << 5)) != 0;
+    bool avx512f = (leaf7ebx & (1u << 16)) != 0;
+
+    // The CPU having the instructions isn't enough; the OS has to save the registers.
+    uint64_t xcr0 = osxsave ? readExtendedControlRegister() : 0;
+    bool ymmState = (xcr0 & 0x6) == 0x6;
+    bool zmmState = (xcr0 & 0xE6) == 0xE6;
+#if defined(__APPLE__)
+    // macOS only turns on ZMM state once a thread first uses it, so XCR0 can't tell.
+    zmmState = ymmState && sysctlFlag("hw.optional.avx512f");
+#endif
+
+    features.avx2 = avx && avx2 && fma && ymmState;
+    features.avx512f = features.avx2 && avx512f && zmmState;
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+    features.neon = true;
+#endif
+    return features;
+}
+
+// Detected once, on first use.
+static inline const CPUFeatures& cpuFeatures() {
+    static const CPUFeatures features = detectCPUFeatures();
+    return features;
+}
+
+static inline bool kernelVariantSupported(int variant) {
+    const CPUFeatures& features = cpuFeatures();
+    switch (variant) {
+        case KernelVariantScalar: return true;
+        case KernelVariantSSE2:   return features.sse2;
+        case KernelVariantAVX2:   return features.avx2;
+        case KernelVariantAVX512: return features.avx512f;
+        case KernelVariantNEON:   return features.neon;
+        default:                  return false;
+    }
+}
+
+/*
+ The widest supported variant that the channel count can fill. A stereo
+ stream stays scalar: half-empty vectors cost more than they save.
+ */
+static inline int preferredKernelVariant(int channelCount) {
+    static const int widestFirst[] = {
+        KernelVariantAVX512, KernelVariantAVX2, KernelVariantSSE2, KernelVariantNEON
+    };
+    for (int variant : widestFirst) {
+        if (kernelVariantSupported(variant) && kernelVariantLanes(variant) <= channelCount) {
+            return variant;
+        }
+    }
+    return KernelVariantScalar;
+}
+
+// MARK: Filter loops
+
+#define KERNEL_INLINE inline __attribute__((always_inline))
+
+#if KERNEL_DISPATCH_X86
+#define KERNEL_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define KERNEL_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+typedef float KernelFloat4 __attribute__((vector_size(16)));
+typedef float KernelFloat8 __attribute__((vector_size(32)));
+typedef float KernelFloat16 __attribute__((vector_size(64)));
+typedef double KernelDouble4 __attribute__((vector_size(32)));
+typedef double KernelDouble8 __attribute__((vector_size(64)));
+typedef double KernelDouble16 __attribute__((vector_size(128)));
+
+// The double vector with as many lanes as a float one, for loops that keep double state.
+template <typename Vector> struct KernelDoubleVector;
+template <> struct KernelDoubleVector<KernelFloat4> { typedef KernelDouble4 Type; };
+template <> struct KernelDoubleVector<KernelFloat8> { typedef KernelDouble8 Type; };
+template <> struct KernelDoubleVector<KernelFloat16> { typedef KernelDouble16 Type; };
+
+/*
+ The vector loops stage a few frames of every lane in a frame-major tile, so
+ the filter itself only does whole-vector loads and stores; the transposes
+ in and out are plain copies the compiler can schedule freely.
+ */
+static constexpr AUAudioFrameCount kernelTileFrames = 16;
+
+template <int lanes, typename Sample>
+static KERNEL_INLINE void loadTile(Sample* tile, const float* const* in,
+                                   AUAudioFrameCount tileStart, AUAudioFrameCount tileLength) {
+    for (int lane = 0; lane < lanes; ++lane) {
+        const float* source = in[lane] + tileStart;
+        for (AUAudioFrameCount frameIndex = 0; frameIndex < tileLength; ++frameIndex) {
+            tile[frameIndex * lanes + lane] = source[frameIndex];
+        }
+    }
+}
+
+template <int lanes, typename Sample>
+static KERNEL_INLINE void storeTile(const Sample* tile, float* const* out,
+                                    AUAudioFrameCount tileStart, AUAudioFrameCount tileLength) {
+    for (int lane = 0; lane < lanes; ++lane) {
+        float* destination = out[lane] + tileStart;
+        for (AUAudioFrameCount frameIndex = 0; frameIndex < tileLength; ++frameIndex) {
+            destination[frameIndex] = float(tile[frameIndex * lanes + lane]);
+        }
+    }
+}
+
+/*
+ Direct Form I over channels [firstChannel, endChannel). State needs x1, x2,
+ y1, y2 and convertBadStateValuesToZero(); Coefficients needs b0, b1, b2,
+ a1, a2. The filter runs at the precision of the state, float or double.
+ */
+template <typename State, typename Coefficients>
+static KERNEL_INLINE void directFormScalar(const Coefficients& coefficients, State* states,
+                                           const AudioBufferList* inBufferList, AudioBufferList* outBufferList,
+                                           int firstChannel, int endChannel,
+                                           AUAudioFrameCount frameCount, AUAudioFrameCount bufferOffset) {
+    // Work on local copies so the coefficients and state stay in registers.
+    const Coefficients c = coefficients;
+
+    typedef decltype(State::y1) Sample;
+
+    for (int channel = firstChannel; channel < endChannel; ++channel) {
+        State state = states[channel];
+        const float* in = (const float*)inBufferList->mBuffers[channel].mData + bufferOffset;
+        float* out      = (float*)outBufferList->mBuffers[channel].mData + bufferOffset;
+
+        for (AUAudioFrameCount frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
+            Sample x0 = in[frameIndex];
+            Sample y0 = (c.b0 * x0) + (c.b1 * state.x1) + (c.b2 * state.x2) - (c.a1 * state.y1) - (c.a2 * state.y2);
+            out[frameIndex] = float(y0);
+
+            state.x2 = state.x1;
+            state.x1 = x0;
+            state.y2 = state.y1;
+            state.y1 = y0;
+        }
+
+        // Squelch any blowups while the state is still in registers.
+        state.convertBadStateValuesToZero();
+        states[channel] = state;
+    }
+}
+
+template <typename Vector, int lanes, typename State, typename Coefficients>
+static KERNEL_INLINE void directFormLanes(const Coefficients& c, State* states,
+                                          const AudioBufferList* inBufferList, AudioBufferList* outBufferList,
+                                          int firstChannel, int endChannel,
+                                          AUAudioFrameCount frameCount, AUAudioFrameCount bufferOffset) {
+    typedef decltype(State::y1) Sample;
+    const Vector zero = {};
+    const Vector b0 = zero + c.b0, b1 = zero + c.b1, b2 = zero + c.b2;
+    const Vector a1 = zero + c.a1, a2 = zero + c.a2;
+
+    int channel = firstChannel;
+    for (; channel + lanes <= endChannel; channel += lanes) {
+        const float* in[lanes];
+        float* out[lanes];
+        Vector x1, x2, y1, y2;
+        for (int lane = 0; lane < lanes; ++lane) {
+            in[lane] = (const float*)inBufferList->mBuffers[channel + lane].mData + bufferOffset;
+            out[lane] = (float*)outBufferList->mBuffers[channel + lane].mData + bufferOffset;
+            x1[lane] = states[channel + lane].x1;
+            x2[lane] = states[channel + lane].x2;
+            y1[lane] = states[channel + lane].y1;
+            y2[lane] = states[channel + lane].y2;
+        }
+
+        for (AUAudioFrameCount tileStart = 0; tileStart < frameCount; tileStart += kernelTileFrames) {
+            AUAudioFrameCount tileLength = std::min(frameCount - tileStart, kernelTileFrames);
+            alignas(64) Sample tile[kernelTileFrames * lanes];
+            loadTile<lanes>(tile, in, tileStart, tileLength);
+
+            for (AUAudioFrameCount frameIndex = 0; frameIndex < tileLength; ++frameIndex) {
+                Vector x0;
+                std::memcpy(&x0, &tile[frameIndex * lanes], sizeof(Vector));
+                Vector y0 = (b0 * x0) + (b1 * x1) + (b2 * x2) - (a1 * y1) - (a2 * y2);
+                std::memcpy(&tile[frameIndex * lanes], &y0, sizeof(Vector));
+
+                x2 = x1;
+                x1 = x0;
+                y2 = y1;
+                y1 = y0;
+            }
+
+            storeTile<lanes>(tile, out, tileStart, tileLength);
+        }
+
+        for (int lane = 0; lane < lanes; ++lane) {
+            State& state = states[channel + lane];
+            state.x1 = x1[lane];
+            state.x2 = x2[lane];
+            state.y1 = y1[lane];
+            state.y2 = y2[lane];
+            state.convertBadStateValuesToZero();
+        }
+    }
+
+    directFormScalar(c, states, inBufferList, outBufferList, channel, endChannel, frameCount, bufferOffset);
+}
+
+/*
+ The state-variable filter at a fixed cutoff. State needs ic1eq, ic2eq and
+ convertBadStateValuesToZero(); Coefficients needs a1, a2, a3, m0, m1, m2.
+ */
+template <typename State, typename Coefficients>
+static KERNEL_INLINE void stateVariableScalar(const Coefficients& coefficients, State* states,
+                                              const AudioBufferList* inBufferList, AudioBufferList* outBufferList,
+                                              int firstChannel, int endChannel,
+                                              AUAudioFrameCount frameCount, AUAudioFrameCount bufferOffset) {
+    const Coefficients c = coefficients;
+    for (int channel = firstChannel; channel < endChannel; ++channel) {
+        State state = states[channel];
+        const float* in = (const float*)inBufferList->mBuffers[channel].mData + bufferOffset;
+        float* out      = (float*)outBufferList->mBuffers[channel].mData + bufferOffset;
+
+        for (AUAudioFrameCount frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
+            out[frameIndex] = c.process(state, in[frameIndex]);
+        }
+
+        state.convertBadStateValuesToZero();
+        states[channel] = state;
+    }
+}
+
+template <typename Vector, int lanes, typename State, typename Coefficients>
+static KERNEL_INLINE void stateVariableLanes(const Coefficients& c, State* states,
+                                             const AudioBufferList* inBufferList, AudioBufferList* outBufferList,
+                                             int firstChannel, int endChannel,
+                                             AUAudioFrameCount frameCount, AUAudioFrameCount bufferOffset) {
+    const Vector zero = {};
+    const Vector two = zero + 2.0f;
+    const Vector a1 = zero + c.a1, a2 = zero + c.a2, a3 = zero + c.a3;
+    const Vector m0 = zero + c.m0, m1 = zero + c.m1, m2 = zero + c.m2;
+
+    int channel = firstChannel;
+    for (; channel + lanes <= endChannel; channel += lanes) {
+        const float* in[lanes];
+        float* out[lanes];
+        Vector ic1eq, ic2eq;
+        for (int lane = 0; lane < lanes; ++lane) {
+            in[lane] = (const float*)inBufferList->mBuffers[channel + lane].mData + bufferOffset;
+            out[lane] = (float*)outBufferList->mBuffers[channel + lane].mData + bufferOffset;
+            ic1eq[lane] = states[channel + lane].ic1eq;
+            ic2eq[lane] = states[channel + lane].ic2eq;
+        }
+
+        for (AUAudioFrameCount tileStart = 0; tileStart < frameCount; tileStart += kernelTileFrames) {
+            AUAudioFrameCount tileLength = std::min(frameCount - tileStart, kernelTileFrames);
+            alignas(64) float tile[kernelTileFrames * lanes];
+            loadTile<lanes>(tile, in, tileStart, tileLength);
+
+            for (AUAudioFrameCount frameIndex = 0; frameIndex < tileLength; ++frameIndex) {
+                Vector v0;
+                std::memcpy(&v0, &tile[frameIndex * lanes], sizeof(Vector));
+                Vector v3 = v0 - ic2eq;
+                Vector v1 = a1 * ic1eq + a2 * v3;
+                Vector v2 = ic2eq + a2 * ic1eq + a3 * v3;
+                ic1eq = two * v1 - ic1eq;
+                ic2eq = two * v2 - ic2eq;
+                Vector y0 = m0 * v0 + m1 * v1 + m2 * v2;
+                std::memcpy(&tile[frameIndex * lanes], &y0, sizeof(Vector));
+            }
+
+            storeTile<lanes>(tile, out, tileStart, tileLength);
+        }
+
+        for (int lane = 0; lane < lanes; ++lane) {
+            State& state = states[channel + lane];
+            state.ic1eq = ic1eq[lane];
+            state.ic2eq = ic2eq[lane];
+            state.convertBadStateValuesToZero();
+        }
+    }
+
+    stateVariableScalar(c, states, inBufferList, outBufferList, channel, endChannel, frameCount, bufferOffset);
+}
+
+/*
+ The rounding error of s = a + b, exactly, whichever of a and b is larger
+ (Knuth's TwoSum). A macro, not a function template, because the template
+ would be instantiated for 8- and 16-lane vectors without the caller's
+ target attribute, and so pass them under a different ABI. The arguments
+ are evaluated more than once, so they mustn't have side effects.
+ */
+#define KERNEL_TWO_SUM_ERROR(a, b, s) (((a) - ((s) - ((s) - (a)))) + ((b) - ((s) - (a))))
+
+/*
+ The error-feedback form described in PreciseBiquad.hpp. State needs s1, v1,
+ sError, vError and convertBadStateValuesToZero(); Coefficients needs n0,
+ n1, n2, d0, q.
+ */
+template <typename State, typename Coefficients>
+static KERNEL_INLINE void errorFeedbackScalar(const Coefficients& coefficients, State* states,
+                                              const AudioBufferList* inBufferList, AudioBufferList* outBufferList,
+                                              int firstChannel, int endChannel,
+                                              AUAudioFrameCount frameCount, AUAudioFrameCount bufferOffset) {
+    const Coefficients c = coefficients;
+    for (int channel = firstChannel; channel < endChannel; ++channel) {
+        State state = states[channel];
+        const float* in = (const float*)inBufferList->mBuffers[channel].mData + bufferOffset;
+        float* out      = (float*)outBufferList->mBuffers[channel].mData + bufferOffset;
+
+        for (AUAudioFrameCount frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
+            float w = in[frameIndex] - (c.d0 * state.s1) - (c.q * state.v1) + state.vError;
+            float v = state.v1 + w;
+            state.vError = KERNEL_TWO_SUM_ERROR(state.v1, w, v);
+            float t = v + state.sError;
+            float s = state.s1 + t;
+            state.sError = KERNEL_TWO_SUM_ERROR(state.s1, t, s);
+            out[frameIndex] = (c.n0 * s) + (c.n1 * v) + (c.n2 * w);
+
+            state.s1 = s;
+            state.v1 = v;
+        }
+
+        state.convertBadStateValuesToZero();
+        states[channel] = state;
+    }
+}
+
+template <typename Vector, int lanes, typename State, typename Coefficients>
+static KERNEL_INLINE void errorFeedbackLanes(const Coefficients& c, State* states,
+                                             const AudioBufferList* inBufferList, AudioBufferList* outBufferList,
+                                             int firstChannel, int endChannel,
+                                             AUAudioFrameCount frameCount, AUAudioFrameCount bufferOffset) {
+    const Vector zero = {};
+    const Vector n0 = zero + c.n0, n1 = zero + c.n1, n2 = zero + c.n2;
+    const Vector d0 = zero + c.d0, q = zero + c.q;
+
+    int channel = firstChannel;
+    for (; channel + lanes <= endChannel; channel += lanes) {
+        const float* in[lanes];
+        float* out[lanes];
+        Vector s1, v1, sError, vError;
+        for (int lane = 0; lane < lanes; ++lane) {
+            in[lane] = (const float*)inBufferList->mBuffers[channel + lane].mData + bufferOffset;
+            out[lane] = (float*)outBufferList->mBuffers[channel + lane].mData + bufferOffset;
+            s1[lane] = states[channel + lane].s1;
+            v1[lane] = states[channel + lane].v1;
+            sError[lane] = states[channel + lane].sError;
+            vError[lane] = states[channel + lane].vError;
+        }
+
+        for (AUAudioFrameCount tileStart = 0; tileStart < frameCount; tileStart += kernelTileFrames) {
+            AUAudioFrameCount tileLength = std::min(frameCount - tileStart, kernelTileFrames);
+            alignas(64) float tile[kernelTileFrames * lanes];
+            loadTile<lanes>(tile, in, tileStart, tileLength);
+
+            for (AUAudioFrameCount frameIndex = 0; frameIndex < tileLength; ++frameIndex) {
+                Vector x0;
+                std::memcpy(&x0, &tile[frameIndex * lanes], sizeof(Vector));
+                Vector w = x0 - (d0 * s1) - (q * v1) + vError;
+                Vector v = v1 + w;
+                vError = KERNEL_TWO_SUM_ERROR(v1, w, v);
+                Vector t = v + sError;
+                Vector s = s1 + t;
+                sError = KERNEL_TWO_SUM_ERROR(s1, t, s);
+                Vector y0 = (n0 * s) + (n1 * v) + (n2 * w);
+                std::memcpy(&tile[frameIndex * lanes], &y0, sizeof(Vector));
+
+                s1 = s;
+                v1 = v;
+            }
+
+            storeTile<lanes>(tile, out, tileStart, tileLength);
+        }
+
+        for (int lane = 0; lane < lanes; ++lane) {
+            State& state = states[channel + lane];
+            state.s1 = s1[lane];
+            state.v1 = v1[lane];
+            state.sError = sError[lane];
+            state.vError = vError[lane];
+            state.convertBadStateValuesToZero();
+        }
+    }
+
+    errorFeedbackScalar(c, states, inBufferList, outBufferList, channel, endChannel, frameCount, bufferOffset);
+}
+
+// Loop policies for ChannelKernels; lanes == 1 selects the scalar loop.
+struct DirectFormLoop {
+    template <typename Vector, int lanes, typename State, typename Coefficients>
+    static KERNEL_INLINE void run(const Coefficients& c, State* s, const AudioBufferList* i, AudioBufferList* o,
+                                  int first, int end, AUAudioFrameCount frames, AUAudioFrameCount offset) {
+        if (lanes == 1) {
+            directFormScalar(c, s, i, o, first, end, frames, offset);
+        }
+        else {
+            directFormLanes<Vector, lanes>(c, s, i, o, first, end, frames, offset);
+        }
+    }
+};
+
+// Direct Form I on double state: the same number of lanes, in twice the registers.
+struct DoubleDirectFormLoop {
+    template <typename Vector, int lanes, typename State, typename Coefficients>
+    static KERNEL_INLINE void run(const Coefficients& c, State* s, const AudioBufferList* i, AudioBufferList* o,
+                                  int first, int end, AUAudioFrameCount frames, AUAudioFrameCount offset) {
+        DirectFormLoop::run<typename KernelDoubleVector<Vector>::Type, lanes>(c, s, i, o, first, end, frames, offset);
+    }
+};
+
+struct ErrorFeedbackLoop {
+    template <typename Vector, int lanes, typename State, typename Coefficients>
+    static KERNEL_INLINE void run(const Coefficients& c, State* s, const AudioBufferList* i, AudioBufferList* o,
+                                  int first, int end, AUAudioFrameCount frames, AUAudioFrameCount offset) {
+        if (lanes == 1) {
+            errorFeedbackScalar(c, s, i, o, first, end, frames, offset);
+        }
+        else {
+            errorFeedbackLanes<Vector, lanes>(c, s, i, o, first, end, frames, offset);
+        }
+    }
+};
+
+struct StateVariableLoop {
+    template <typename Vector, int lanes, typename State, typename Coefficients>
+    static KERNEL_INLINE void run(const Coefficients& c, State* s, const AudioBufferList* i, AudioBufferList* o,
+                                  int first, int end, AUAudioFrameCount frames, AUAudioFrameCount offset) {
+        if (lanes == 1) {
+            stateVariableScalar(c, s, i, o, first, end, frames, offset);
+        }
+        else {
+            stateVariableLanes<Vector, lanes>(c, s, i, o, first, end, frames, offset);
+        }
+    }
+};
+
+/*
+ ChannelKernels
+ One entry point per variant for a loop, each compiled for its own
+ instruction set; the function-level target attribute lets a single binary
+ carry all of them. Only call variants that kernelVariantSupported() allows.
+ */
+template <typename Loop, typename State, typename Coefficients>
+struct ChannelKernels {
+    typedef void (*Function)(const Coefficients&, State*, const AudioBufferList*, AudioBufferList*,
+                             int, int, AUAudioFrameCount, AUAudioFrameCount);
+
+    static void scalar(const Coefficients& c, State* s, const AudioBufferList* i, AudioBufferList* o,
+                       int first, int end, AUAudioFrameCount frames, AUAudioFrameCount offset) {
+        Loop::template run<KernelFloat4, 1>(c, s, i, o, first, end, frames, offset);
+    }
+
+    // SSE2 on x86-64, NEON on arm64: both are the baseline, so no target attribute is needed.
+    static void float4(const Coefficients& c, State* s, const AudioBufferList* i, AudioBufferList* o,
+                       int first, int end, AUAudioFrameCount frames, AUAudioFrameCount offset) {
+        Loop::template run<KernelFloat4, 4>(c, s, i, o, first, end, frames, offset);
+    }
+
+#if KERNEL_DISPATCH_X86
+    KERNEL_TARGET_AVX2
+    static void avx2(const Coefficients& c, State* s, const AudioBufferList* i, AudioBufferList* o,
+                     int first, int end, AUAudioFrameCount frames, AUAudioFrameCount offset) {
+        Loop::template run<KernelFloat8, 8>(c, s, i, o, first, end, frames, offset);
+    }
+
+    KERNEL_TARGET_AVX512
+    static void avx512(const Coefficients& c, State* s, const AudioBufferList* i, AudioBufferList* o,
+                       int first, int end, AUAudioFrameCount frames, AUAudioFrameCount offset) {
+        Loop::template run<KernelFloat16, 16>(c, s, i, o, first, end, frames, offset);
+    }
+#endif
+
+    static Function forVariant(int variant) {
+        switch (variant) {
+#if KERNEL_DISPATCH_X86
+            case KernelVariantSSE2:   return &float4;
+            case KernelVariantAVX2:   return &avx2;
+            case KernelVariantAVX512: return &avx512;
+#else
+            case KernelVariantNEON:   return &float4;
+#endif
+            default:                  return &scalar;
+        }
+    }
+};
+
+#endif /* KernelDispatch_hpp */
@@ -0,0 +1,245 @@
+//
+//  MIDIControl.hpp
+//  BiquadFilter
+//
+//  The pieces FilterDSPKernel uses to take MIDI directly: a controller map
+//  with learn, a held-note stack for key tracking, control-rate smoothing,
+//  and the queue that holds events until the frame they fall on.
+//
+
+#ifndef MIDIControl_hpp
+#define MIDIControl_hpp
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <atomic>
+#import <cmath>
+#import <cstdint>
+
+/*
+ MIDIControllerMap
+ Which parameter each continuous controller (CC 0-119; the rest are channel
+ mode messages) moves. The UI edits it while the render thread reads it, so
+ every entry is an atomic. learn() arms the map: the next controller the
+ render thread sees is bound to the parameter, replacing any controller
+ that was bound to it before.
+ */
+class MIDIControllerMap {
+public:
+    static constexpr int controllerCount = 120;
+    static constexpr int32_t unmapped = -1;
+
+    MIDIControllerMap() {
+        clear();
+    }
+
+    // Any thread.
+    void map(int controller, int32_t address) {
+        if (controller >= 0 && controller < controllerCount) {
+            addresses[controller].store(address < 0 ? unmapped : address, std::memory_order_relaxed);
+        }
+    }
+
+    void clear() {
+        for (std::atomic<int32_t>& address : addresses) {
+            address.store(unmapped, std::memory_order_relaxed);
+        }
+    }
+
+    int32_t parameterForController(int controller) const {
+        if (controller < 0 || controller >= controllerCount) {
+            return unmapped;
+        }
+        return addresses[controller].load(std::memory_order_relaxed);
+    }
+
+    void learn(int32_t address) {
+        learnedController.store(-1, std::memory_order_relaxed);
+        learnAddress.store(address < 0 ? unmapped : address, std::memory_order_release);
+    }
+
+    void cancelLearn() {
+        learnAddress.store(unmapped, std::memory_order_relaxed);
+    }
+
+    bool isLearning() const {
+        return learnAddress.load(std::memory_order_relaxed) != unmapped;
+    }
+
+    // The parameter the next controller will be bound to, or unmapped.
+    int32_t learningParameter() const {
+        return learnAddress.load(std::memory_order_relaxed);
+    }
+
+    // The controller the last learn() bound, or -1 while still waiting.
+    int lastLearnedController() const {
+        return learnedController.load(std::memory_order_acquire);
+    }
+
+    // Render thread. Completes a pending learn, then returns the parameter to move.
+    int32_t route(int controller) {
+        if (controller < 0 || controller >= controllerCount) {
+            return unmapped;
+        }
+        int32_t address = learnAddress.load(std::memory_order_acquire);
+        if (address != unmapped && learnAddress.compare_exchange_strong(address, unmapped)) {
+            for (std::atomic<int32_t>& mapped : addresses) {
+                if (mapped.load(std::memory_order_relaxed) == address) {
+                    mapped.store(unmapped, std::memory_order_relaxed);
+                }
+            }
+            addresses[controller].store(address, std::memory_order_relaxed);
+            learnedController.store(controller, std::memory_order_release);
+        }
+        return addresses[controller].load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int32_t> addresses[controllerCount];
+    std::atomic<int32_t> learnAddress { unmapped };
+    std::atomic<int> learnedController { -1 };
+};
+
+/*
+ HeldNotes
+ The keys that are down, newest last, for last-note priority. Releasing the
+ newest falls back to the one before, so legato lines track smoothly.
+ */
+class HeldNotes {
+public:
+    static constexpr int capacity = 16;
+
+    void noteOn(int note) {
+        remove(note);
+        if (count == capacity) {
+            // Forget the oldest.
+            for (int i = 1; i < count; ++i) {
+                notes[i - 1] = notes[i];
+            }
+            --count;
+        }
+        notes[count++] = uint8_t(note);
+    }
+
+    void noteOff(int note) {
+        remove(note);
+    }
+
+    void clear() {
+        count = 0;
+    }
+
+    // The newest held note, or -1 if none is.
+    int current() const {
+        return count > 0 ? notes[count - 1] : -1;
+    }
+
+private:
+    void remove(int note) {
+        int kept = 0;
+        for (int i = 0; i < count; ++i) {
+            if (notes[i] != note) {
+                notes[kept++] = notes[i];
+            }
+        }
+        count = kept;
+    }
+
+    uint8_t notes[capacity];
+    int count = 0;
+};
+
+/*
+ ControlSmoother
+ A one-pole glide toward a target, stepped once per control period. The
+ coefficient comes from the kernel, which shares one between its smoothers.
+ Once within tolerance of the target it lands on it exactly, so a settled
+ smoother reads back the value it was given.
+ */
+class ControlSmoother {
+public:
+    void jump(float value) {
+        current = value;
+        goal = value;
+        gliding = false;
+    }
+
+    void glide(float value) {
+        goal = value;
+        gliding = current != goal;
+    }
+
+    // Render thread, once per control period.
+    void step(float coefficient, float tolerance) {
+        if (!gliding) {
+            return;
+        }
+        current = goal + coefficient * (current - goal);
+        if (std::fabs(current - goal) <= tolerance) {
+            current = goal;
+            gliding = false;
+        }
+    }
+
+    float value() const { return current; }
+    float target() const { return goal; }
+    bool isGliding() const { return gliding; }
+
+private:
+    float current = 0.0;
+    float goal = 0.0;
+    bool gliding = false;
+};
+
+/*
+ ScheduledMIDIEvents
+ Short channel messages waiting for the frame they fall on, given as an
+ offset into the current render call. Events arrive in time order, so this
+ is a plain FIFO; it's emptied by the end of every render call.
+ */
+class ScheduledMIDIEvents {
+public:
+    static constexpr int capacity = 256;
+
+    struct Event {
+        AUAudioFrameCount frameOffset;
+        uint8_t status;
+        uint8_t data1;
+        uint8_t data2;
+    };
+
+    // False if the queue is full. Reads only the bytes the event has.
+    bool push(AUMIDIEvent const& midiEvent, AUAudioFrameCount frameOffset) {
+        if (tail == capacity) {
+            return false;
+        }
+        Event& event = events[tail++];
+        event.frameOffset = frameOffset;
+        event.status = midiEvent.length > 0 ? midiEvent.data[0] : 0;
+        event.data1 = midiEvent.length > 1 ? midiEvent.data[1] : 0;
+        event.data2 = midiEvent.length > 2 ? midiEvent.data[2] : 0;
+        return true;
+    }
+
+    bool isEmpty() const {
+        return head == tail;
+    }
+
+    // Only valid when the queue isn't empty.
+    const Event& front() const {
+        return events[head];
+    }
+
+    void pop() {
+        if (++head == tail) {
+            head = 0;
+            tail = 0;
+        }
+    }
+
+private:
+    Event events[capacity];
+    int head = 0;
+    int tail = 0;
+};
+
+#endif /* MIDIControl_hpp */
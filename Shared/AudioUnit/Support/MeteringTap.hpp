@@ -0,0 +1,275 @@
+//
+//  MeteringTap.hpp
+//  BiquadFilter
+//
+//  Real-time safe metering and spectrum tap for the filter kernel.
+//
+
+#ifndef MeteringTap_hpp
+#define MeteringTap_hpp
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <atomic>
+#import <chrono>
+#import <cmath>
+#import <cstdint>
+#import <vector>
+
+#import "AlignedStateStore.hpp"
+#import "SPSCRingBuffer.hpp"
+
+/*
+ MeteringTap
+ The render thread calls captureInput() before the filter runs and
+ captureOutput() after it. Together they:
+  - publish per-channel peak and RMS of the input and output through
+    atomics, and
+  - push a mono, decimated copy of the input and output into two SPSC rings
+    for a UI-side spectrum analyzer.
+
+ Whether the tap is enabled is read once per callback, by captureInput(),
+ and captureOutput() is told what it returned, so a callback captures both
+ halves or neither and the rings stay aligned however the consumer toggles
+ it. Nothing here locks or allocates on the render thread. The per-callback
+ cost is one pass over each buffer plus frameCount / decimation ring writes,
+ and it's timed so the UI can display it. When disabled, a callback costs a
+ single load.
+ */
+class MeteringTap {
+public:
+    struct ChannelMeter {
+        std::atomic<float> peak { 0.0f };
+        std::atomic<float> meanSquare { 0.0f };
+    };
+
+    static constexpr int defaultDecimation = 2;
+    static constexpr size_t ringCapacity = 16384;
+    static constexpr double rmsTimeConstant = 0.3;  // seconds
+
+    // Not real-time safe. Only grows.
+    void allocate(int maximumChannels, AUAudioFrameCount maximumFrames) {
+        inputMeters.allocate(maximumChannels);
+        inputMeters.setCount(maximumChannels);
+        outputMeters.allocate(maximumChannels);
+        outputMeters.setCount(maximumChannels);
+        if (scratch.size() < maximumFrames) {
+            scratch.resize(maximumFrames);
+        }
+        if (inputRing.capacity() == 0) {
+            inputRing.allocate(ringCapacity);
+            outputRing.allocate(ringCapacity);
+        }
+    }
+
+    void setSampleRate(double inSampleRate) {
+        sampleRate = inSampleRate;
+    }
+
+    bool isEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // Called by the consumer. Starting clears any stale samples and meters.
+    void setEnabled(bool shouldEnable) {
+        if (shouldEnable && !isEnabled()) {
+            inputRing.clear();
+            outputRing.clear();
+            clearMeters(inputMeters);
+            clearMeters(outputMeters);
+            maximumCost.store(0, std::memory_order_relaxed);
+            // Tells the render thread to restart both decimators in phase.
+            enableCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        enabled.store(shouldEnable, std::memory_order_release);
+    }
+
+    // Takes effect at the next callback; call from the consumer.
+    void setDecimation(int inDecimation) {
+        decimation.store(std::max(inDecimation, 1), std::memory_order_relaxed);
+    }
+
+    double tapSampleRate() const {
+        return sampleRate / double(decimation.load(std::memory_order_relaxed));
+    }
+
+    // MARK: Render thread
+
+    // Returns whether the tap is enabled for this callback; pass that to captureOutput().
+    bool captureInput(const AudioBufferList* bufferList, int channelCount, AUAudioFrameCount frameCount) {
+        if (!enabled.load(std::memory_order_acquire)) {
+            return false;
+        }
+        auto start = std::chrono::steady_clock::now();
+        uint32_t enables = enableCount.load(std::memory_order_relaxed);
+        if (enables != capturedEnableCount) {
+            capturedEnableCount = enables;
+            inputDecimator = Decimator();
+            outputDecimator = Decimator();
+        }
+        // Both halves of a callback must decimate by the same factor.
+        callbackDecimation = decimation.load(std::memory_order_relaxed);
+        inputWritten = capture(bufferList, channelCount, frameCount, inputDecimator, inputRing, inputMeters, SIZE_MAX);
+        callbackCost = std::chrono::steady_clock::now() - start;
+        return true;
+    }
+
+    void captureOutput(const AudioBufferList* bufferList, int channelCount, AUAudioFrameCount frameCount,
+                       bool capturedInput) {
+        if (!capturedInput) {
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        // Never write more output than input, so the two rings stay sample aligned.
+        capture(bufferList, channelCount, frameCount, outputDecimator, outputRing, outputMeters, inputWritten);
+        callbackCost += std::chrono::steady_clock::now() - start;
+
+        uint64_t cost = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(callbackCost).count());
+        lastCost.store(cost, std::memory_order_relaxed);
+        if (cost > maximumCost.load(std::memory_order_relaxed)) {
+            maximumCost.store(cost, std::memory_order_relaxed);
+        }
+    }
+
+    // MARK: Consumer thread
+
+    // Reads matching runs of decimated input and output. Returns the number read.
+    size_t read(float* input, float* output, size_t count) {
+        count = std::min(count, std::min(inputRing.availableToRead(), outputRing.availableToRead()));
+        inputRing.read(input, count);
+        outputRing.read(output, count);
+        return count;
+    }
+
+    int channelCount() const {
+        return outputMeters.size();
+    }
+
+    // The output's peak since the previous call for this channel.
+    float takePeak(int channel) {
+        return outputMeters[channel].peak.exchange(0.0f, std::memory_order_relaxed);
+    }
+
+    float rms(int channel) const {
+        return std::sqrt(outputMeters[channel].meanSquare.load(std::memory_order_relaxed));
+    }
+
+    // The same for the input, before the filter.
+    float takeInputPeak(int channel) {
+        return inputMeters[channel].peak.exchange(0.0f, std::memory_order_relaxed);
+    }
+
+    float inputRMS(int channel) const {
+        return std::sqrt(inputMeters[channel].meanSquare.load(std::memory_order_relaxed));
+    }
+
+    uint64_t lastCostNanoseconds() const {
+        return lastCost.load(std::memory_order_relaxed);
+    }
+
+    uint64_t maximumCostNanoseconds() const {
+        return maximumCost.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Decimator {
+        float sum = 0.0;
+        int phase = 0;
+    };
+
+    // Returns the number of decimated samples written to the ring.
+    size_t capture(const AudioBufferList* bufferList, int channelCount, AUAudioFrameCount frameCount,
+                   Decimator& decimator, SPSCRingBuffer<float>& ring, AlignedStateStore<ChannelMeter>& meters,
+                   size_t writeLimit) {
+        frameCount = std::min(frameCount, AUAudioFrameCount(scratch.size()));
+        channelCount = std::min(channelCount, int(bufferList->mNumberBuffers));
+        if (frameCount == 0 || channelCount == 0) {
+            return 0;
+        }
+
+        float* mix = scratch.data();
+        std::fill(mix, mix + frameCount, 0.0f);
+
+        float smoothing = float(std::exp(-double(frameCount) / (rmsTimeConstant * sampleRate)));
+        int meteredChannels = std::min(channelCount, meters.size());
+
+        for (int channel = 0; channel < channelCount; ++channel) {
+            const float* samples = (const float*)bufferList->mBuffers[channel].mData;
+
+            if (channel < meteredChannels) {
+                float peak = 0.0;
+                float sumOfSquares = 0.0;
+                for (AUAudioFrameCount i = 0; i < frameCount; ++i) {
+                    float x = samples[i];
+                    mix[i] += x;
+                    peak = std::max(peak, std::fabs(x));
+                    sumOfSquares += x * x;
+                }
+                publish(meters[channel], peak, sumOfSquares / float(frameCount), smoothing);
+            }
+            else {
+                for (AUAudioFrameCount i = 0; i < frameCount; ++i) {
+                    mix[i] += samples[i];
+                }
+            }
+        }
+
+        /*
+         Average down to mono and boxcar-decimate. The boxcar is a crude
+         anti-aliasing filter, which is enough for a display. Decimated
+         samples are written back into the front of the scratch buffer.
+         */
+        int factor = callbackDecimation;
+        float gain = 1.0f / float(channelCount * factor);
+        size_t decimatedCount = 0;
+        for (AUAudioFrameCount i = 0; i < frameCount; ++i) {
+            decimator.sum += mix[i];
+            if (++decimator.phase >= factor) {
+                mix[decimatedCount++] = decimator.sum * gain;
+                decimator.sum = 0.0;
+                decimator.phase = 0;
+            }
+        }
+
+        // Drops samples if the consumer has fallen behind.
+        return ring.write(mix, std::min(decimatedCount, writeLimit));
+    }
+
+    static void clearMeters(AlignedStateStore<ChannelMeter>& meters) {
+        for (ChannelMeter& meter : meters) {
+            meter.peak.store(0.0f, std::memory_order_relaxed);
+            meter.meanSquare.store(0.0f, std::memory_order_relaxed);
+        }
+    }
+
+    void publish(ChannelMeter& meter, float peak, float meanSquare, float smoothing) {
+        // Only the consumer resets the peak, so this can't lose a larger value for long.
+        if (peak > meter.peak.load(std::memory_order_relaxed)) {
+            meter.peak.store(peak, std::memory_order_relaxed);
+        }
+        float previous = meter.meanSquare.load(std::memory_order_relaxed);
+        meter.meanSquare.store(meanSquare + smoothing * (previous - meanSquare), std::memory_order_relaxed);
+    }
+
+    std::atomic<bool> enabled { false };
+    std::atomic<uint32_t> enableCount { 0 };
+    std::atomic<int> decimation { defaultDecimation };
+    double sampleRate = 44100.0;
+
+    AlignedStateStore<ChannelMeter> inputMeters;
+    AlignedStateStore<ChannelMeter> outputMeters;
+    std::vector<float> scratch;
+
+    Decimator inputDecimator;
+    Decimator outputDecimator;
+    SPSCRingBuffer<float> inputRing;
+    SPSCRingBuffer<float> outputRing;
+
+    uint32_t capturedEnableCount = 0;
+    int callbackDecimation = defaultDecimation;
+    size_t inputWritten = 0;
+    std::chrono::steady_clock::duration callbackCost { 0 };
+    std::atomic<uint64_t> lastCost { 0 };
+    std::atomic<uint64_t> maximumCost { 0 };
+};
+
+#endif /* MeteringTap_hpp */
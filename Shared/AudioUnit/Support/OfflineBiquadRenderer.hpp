@@ -0,0 +1,602 @@
+//
+//  OfflineBiquadRenderer.hpp
+//  BiquadFilter
+//
+//  Filters long recordings offline, outside the render callback.
+//
+
+#ifndef OfflineBiquadRenderer_hpp
+#define OfflineBiquadRenderer_hpp
+
+#import <algorithm>
+#import <atomic>
+#import <cmath>
+#import <cstring>
+#import <functional>
+#import <thread>
+#import <vector>
+
+#import "FilterDSPKernel.hpp"
+
+/*
+ OfflineBiquadCoefficients
+ A design and the arithmetic to run it in. Float is the kernel's single
+ precision Direct Form I, with the same float-rounded coefficients; double is
+ its double precision form. The kernel's error feedback form exists to keep
+ float vectors accurate at low cutoffs, and an offline render gets the same
+ accuracy or better from double, so it uses that instead.
+ */
+struct OfflineBiquadCoefficients {
+    PreciseBiquadCoefficients precise;
+    bool doublePrecision = false;
+
+    void calculateCoefficients(double frequency, double resonance, PARAM_ITEM_FILTER_TYPE filterType,
+                               double sampleRate, PARAM_ITEM_FILTER_PRECISION form) {
+        precise.calculateCoefficients(frequency, resonance, filterType, sampleRate);
+        doublePrecision = form != PARAM_ITEM_FILTER_PRECISION_SINGLE;
+    }
+};
+
+// Held in double either way; a float render only ever stores floats in it.
+typedef DoubleFilterState OfflineBiquadState;
+
+// The coefficients rounded to the precision the recursion runs in.
+template <typename Sample>
+struct OfflineBiquadTaps {
+    Sample b0, b1, b2, a1, a2;
+
+    explicit OfflineBiquadTaps(const PreciseBiquadCoefficients& c)
+        : b0(Sample(c.b0)), b1(Sample(c.b1)), b2(Sample(c.b2)), a1(Sample(c.a1)), a2(Sample(c.a2)) {}
+};
+
+// Loads and stores the state in the precision the recursion runs in.
+template <typename Sample>
+struct OfflineBiquadHistory {
+    Sample x1, x2, y1, y2;
+
+    explicit OfflineBiquadHistory(const OfflineBiquadState& state)
+        : x1(Sample(state.x1)), x2(Sample(state.x2)), y1(Sample(state.y1)), y2(Sample(state.y2)) {}
+
+    void push(Sample x0, Sample y0) {
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = y0;
+    }
+
+    void store(OfflineBiquadState& state) const {
+        state.x1 = x1;
+        state.x2 = x2;
+        state.y1 = y1;
+        state.y2 = y2;
+        state.convertBadStateValuesToZero();
+    }
+};
+
+// The same Direct Form I recursion as FilterDSPKernel::processDirectForm, in Sample.
+template <typename Sample>
+static inline void filterBiquad(const PreciseBiquadCoefficients& coefficients, OfflineBiquadState& state,
+                                const float* in, float* out, AUAudioFrameCount frameCount) {
+    const OfflineBiquadTaps<Sample> c(coefficients);
+    OfflineBiquadHistory<Sample> s(state);
+    for (AUAudioFrameCount frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
+        Sample x0 = in[frameIndex];
+        Sample y0 = (c.b0 * x0) + (c.b1 * s.x1) + (c.b2 * s.x2) - (c.a1 * s.y1) - (c.a2 * s.y2);
+        out[frameIndex] = float(y0);
+        s.push(x0, y0);
+    }
+    s.store(state);
+}
+
+template <typename Sample>
+static inline void settleBiquad(const PreciseBiquadCoefficients& coefficients, OfflineBiquadState& state,
+                                const float* in, AUAudioFrameCount frameCount) {
+    const OfflineBiquadTaps<Sample> c(coefficients);
+    OfflineBiquadHistory<Sample> s(state);
+    for (AUAudioFrameCount frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
+        Sample x0 = in[frameIndex];
+        Sample y0 = (c.b0 * x0) + (c.b1 * s.x1) + (c.b2 * s.x2) - (c.a1 * s.y1) - (c.a2 * s.y2);
+        s.push(x0, y0);
+    }
+    s.store(state);
+}
+
+template <typename Sample>
+static inline void filterBiquadReversed(const PreciseBiquadCoefficients& coefficients, OfflineBiquadState& state,
+                                        const float* in, float* out, AUAudioFrameCount frameCount) {
+    const OfflineBiquadTaps<Sample> c(coefficients);
+    OfflineBiquadHistory<Sample> s(state);
+    for (AUAudioFrameCount frameIndex = frameCount; frameIndex-- > 0;) {
+        Sample x0 = in[frameIndex];
+        Sample y0 = (c.b0 * x0) + (c.b1 * s.x1) + (c.b2 * s.x2) - (c.a1 * s.y1) - (c.a2 * s.y2);
+        out[frameIndex] = float(y0);
+        s.push(x0, y0);
+    }
+    s.store(state);
+}
+
+static inline void filterBiquad(const OfflineBiquadCoefficients& c, OfflineBiquadState& state,
+                                const float* in, float* out, AUAudioFrameCount frameCount) {
+    if (c.doublePrecision) {
+        filterBiquad<double>(c.precise, state, in, out, frameCount);
+    }
+    else {
+        filterBiquad<float>(c.precise, state, in, out, frameCount);
+    }
+}
+
+// Feeds frames through the filter only to settle its state.
+static inline void settleBiquad(const OfflineBiquadCoefficients& c, OfflineBiquadState& state,
+                                const float* in, AUAudioFrameCount frameCount) {
+    if (c.doublePrecision) {
+        settleBiquad<double>(c.precise, state, in, frameCount);
+    }
+    else {
+        settleBiquad<float>(c.precise, state, in, frameCount);
+    }
+}
+
+// The same recursion run from the last frame to the first. in and out may be the same buffer.
+static inline void filterBiquadReversed(const OfflineBiquadCoefficients& c, OfflineBiquadState& state,
+                                        const float* in, float* out, AUAudioFrameCount frameCount) {
+    if (c.doublePrecision) {
+        filterBiquadReversed<double>(c.precise, state, in, out, frameCount);
+    }
+    else {
+        filterBiquadReversed<float>(c.precise, state, in, out, frameCount);
+    }
+}
+
+// The state the filter would be in after an endless run of value, so starting there has no step transient.
+static inline OfflineBiquadState steadyBiquadState(const OfflineBiquadCoefficients& coefficients, float value) {
+    const PreciseBiquadCoefficients& c = coefficients.precise;
+    OfflineBiquadState state;
+    double denominator = 1.0 + c.a1 + c.a2;
+    double output = std::fabs(denominator) > 1.0e-12 ? value * (c.b0 + c.b1 + c.b2) / denominator : 0.0;
+    state.x1 = value;
+    state.x2 = value;
+    state.y1 = coefficients.doublePrecision ? output : double(float(output));
+    state.y2 = state.y1;
+    return state;
+}
+
+/*
+ The number of frames after which a wrong starting state has decayed to
+ tolerance times its size. The feedback's impulse response is bounded by
+ (n + 1) * r^n, r being the larger pole radius, which also covers coincident
+ and nearly coincident poles. The two input taps are exact after two frames.
+ Returns 0 if the filter doesn't decay (r >= 1).
+ */
+static inline AUAudioFrameCount biquadDecayFrames(const OfflineBiquadCoefficients& c, double tolerance) {
+    double a1 = c.precise.a1;
+    double a2 = c.precise.a2;
+    double discriminant = a1 * a1 - 4.0 * a2;
+    double radius;
+    if (discriminant < 0.0) {
+        radius = std::sqrt(std::max(a2, 0.0));
+    }
+    else {
+        double root = std::sqrt(discriminant);
+        radius = std::max(std::fabs(-a1 + root), std::fabs(-a1 - root)) * 0.5;
+    }
+
+    if (radius >= 1.0 || !std::isfinite(radius)) {
+        return 0;
+    }
+    if (radius < 1.0e-12) {
+        return 2;
+    }
+
+    double logTolerance = std::log(clamp(tolerance, 1.0e-12, 0.5));
+    double logRadius = std::log(radius);
+    double n = std::ceil(logTolerance / logRadius);
+    while (std::log(n + 1.0) + n * logRadius > logTolerance) {
+        n = std::ceil(n * 1.1 + 1.0);
+    }
+    return AUAudioFrameCount(std::min(n + 2.0, 4.0e9));
+}
+
+/*
+ ChunkedBiquadRenderer
+ Splits a long static-parameter render into chunks filtered on separate
+ threads. The first chunk of each process() call continues from the state
+ the previous call ended with. Every other chunk starts from silence and
+ first runs through the preRollFrames() frames before it, so its state has
+ converged by the time its output is kept.
+
+ Tolerance: where chunks join, the output differs from a serial render by at
+ most about tolerance times the filter's output level just before the join,
+ on top of float rounding. For low cutoffs the rounding dominates: a serial
+ float render of a 200 Hz, Q 5 lowpass at 48 kHz is itself already about
+ 1e-4 of full scale away from a double-precision one, and the chunked render
+ stays within that. Filters too slow to decay within half a chunk (a cutoff
+ of a few hertz, say) are rendered serially and match exactly.
+
+ Memory stays bounded: the caller decides how much audio each process() call
+ sees, and the renderer only keeps a copy of the pre-roll frames, which lets
+ it filter in place.
+ */
+class ChunkedBiquadRenderer {
+public:
+    // Not thread safe; configure before processing.
+    void setCoefficients(const OfflineBiquadCoefficients& inCoefficients, int inChannelCount) {
+        coefficients = inCoefficients;
+        channelCount = std::max(inChannelCount, 0);
+        states.assign(channelCount, OfflineBiquadState());
+        updatePreRoll();
+    }
+
+    // Relative error allowed where chunks join; 1e-6 is -120 dB.
+    void setTolerance(double inTolerance) {
+        tolerance = inTolerance;
+        updatePreRoll();
+    }
+
+    // Overrides the pre-roll derived from the decay time. Zero goes back to deriving it.
+    void setPreRollFrames(AUAudioFrameCount frames) {
+        preRollOverride = frames;
+        updatePreRoll();
+    }
+
+    void setChunkFrames(AUAudioFrameCount frames) {
+        chunkFrames = std::max(frames, AUAudioFrameCount(1024));
+    }
+
+    // Zero uses every core.
+    void setThreadCount(int inThreadCount) {
+        threadCount = std::max(inThreadCount, 0);
+    }
+
+    double getTolerance() const { return tolerance; }
+    AUAudioFrameCount preRollFrames() const { return preRoll; }
+    AUAudioFrameCount getChunkFrames() const { return chunkFrames; }
+
+    // True if the filter decays too slowly to split, so every chunk runs in order.
+    bool rendersSerially() const {
+        return preRoll == 0 || preRoll > chunkFrames / 2;
+    }
+
+    // The frames per process() call that keep every thread busy.
+    AUAudioFrameCount preferredBlockFrames() const {
+        return chunkFrames * AUAudioFrameCount(resolvedThreadCount());
+    }
+
+    void reset() {
+        states.assign(channelCount, OfflineBiquadState());
+    }
+
+    /*
+     Filters frameCount frames of every channel, continuing from the previous
+     call. input and output may be the same buffers.
+     */
+    void process(const float* const* input, float* const* output, AUAudioFrameCount frameCount) {
+        if (frameCount == 0 || channelCount == 0) {
+            return;
+        }
+
+        int chunkCount = int((frameCount + chunkFrames - 1) / chunkFrames);
+        if (rendersSerially() || chunkCount == 1) {
+            for (int channel = 0; channel < channelCount; ++channel) {
+                filterBiquad(coefficients, states[channel], input[channel], output[channel], frameCount);
+            }
+            return;
+        }
+
+        // Copy each join's pre-roll now; an in-place render would overwrite it.
+        preRollCopies.resize(size_t(chunkCount - 1) * channelCount * preRoll);
+        for (int chunk = 1; chunk < chunkCount; ++chunk) {
+            AUAudioFrameCount start = AUAudioFrameCount(chunk) * chunkFrames;
+            for (int channel = 0; channel < channelCount; ++channel) {
+                std::copy(input[channel] + start - preRoll, input[channel] + start, preRollCopy(chunk, channel));
+            }
+        }
+
+        std::vector<OfflineBiquadState> finalStates(channelCount);
+        std::atomic<int> nextItem { 0 };
+        int itemCount = chunkCount * channelCount;
+
+        auto work = [&] {
+            for (int item = nextItem++; item < itemCount; item = nextItem++) {
+                int chunk = item / channelCount;
+                int channel = item % channelCount;
+                AUAudioFrameCount start = AUAudioFrameCount(chunk) * chunkFrames;
+                AUAudioFrameCount frames = std::min(chunkFrames, frameCount - start);
+
+                OfflineBiquadState state;
+                if (chunk == 0) {
+                    state = states[channel];
+                }
+                else {
+                    settleBiquad(coefficients, state, preRollCopy(chunk, channel), preRoll);
+                }
+                filterBiquad(coefficients, state, input[channel] + start, output[channel] + start, frames);
+
+                if (chunk == chunkCount - 1) {
+                    finalStates[channel] = state;
+                }
+            }
+        };
+
+        int workerCount = std::min(resolvedThreadCount(), itemCount) - 1;
+        std::vector<std::thread> workers;
+        workers.reserve(workerCount);
+        for (int i = 0; i < workerCount; ++i) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        states.swap(finalStates);
+    }
+
+private:
+    float* preRollCopy(int chunk, int channel) {
+        return preRollCopies.data() + (size_t(chunk - 1) * channelCount + channel) * preRoll;
+    }
+
+    int resolvedThreadCount() const {
+        if (threadCount > 0) {
+            return threadCount;
+        }
+        return std::max(int(std::thread::hardware_concurrency()), 1);
+    }
+
+    void updatePreRoll() {
+        preRoll = preRollOverride > 0 ? preRollOverride : biquadDecayFrames(coefficients, tolerance);
+    }
+
+    OfflineBiquadCoefficients coefficients;
+    int channelCount = 0;
+    std::vector<OfflineBiquadState> states;
+    std::vector<float> preRollCopies;
+
+    double tolerance = 1.0e-6;
+    AUAudioFrameCount preRollOverride = 0;
+    AUAudioFrameCount preRoll = 2;
+    AUAudioFrameCount chunkFrames = 1 << 18;
+    int threadCount = 0;
+};
+
+/*
+ ZeroPhaseBiquadRenderer
+ Forward-backward filtering: the filter runs forward over the signal, then
+ backward over the result, which cancels its phase response and squares its
+ magnitude response.
+
+ The backward pass is anticausal, so instead of holding the whole signal it
+ works in blocks: each block of forward output is filtered backward together
+ with the lookaheadFrames() that follow it, starting from the steady state
+ of the lookahead's last frame, and only the block is kept. The lookahead is
+ the decay time for the tolerance, so blocks join within tolerance of the
+ whole-signal result, as in ChunkedBiquadRenderer. Memory is a few blocks
+ per channel whatever the signal's length.
+
+ At both ends the signal is extended by an odd reflection about its first or
+ last frame, and each pass starts from the steady state of its first frame,
+ as filtfilt does. That keeps start-up transients out of the output.
+ */
+class ZeroPhaseBiquadRenderer {
+public:
+    // Fills up to maximumFrames of every channel; frames < maximumFrames means the end. Returns false on error.
+    typedef std::function<bool (float* const* buffers, AUAudioFrameCount maximumFrames, AUAudioFrameCount& frames)> Reader;
+    // Returns false on error.
+    typedef std::function<bool (const float* const* buffers, AUAudioFrameCount frames)> Writer;
+
+    // Keeps a filter that barely decays from needing unbounded memory.
+    static constexpr AUAudioFrameCount maximumLookaheadFrames = 1 << 20;
+
+    void setCoefficients(const OfflineBiquadCoefficients& inCoefficients, int inChannelCount) {
+        coefficients = inCoefficients;
+        channelCount = std::max(inChannelCount, 0);
+    }
+
+    void setTolerance(double inTolerance) {
+        tolerance = inTolerance;
+    }
+
+    void setBlockFrames(AUAudioFrameCount frames) {
+        blockFrames = std::max(frames, AUAudioFrameCount(1024));
+    }
+
+    // Length of the odd reflection at each end. Zero derives it from the decay time.
+    void setEdgePadFrames(AUAudioFrameCount frames) {
+        edgePadOverride = frames;
+    }
+
+    AUAudioFrameCount lookaheadFrames() const {
+        AUAudioFrameCount decay = biquadDecayFrames(coefficients, tolerance);
+        return decay == 0 ? maximumLookaheadFrames : std::min(decay, maximumLookaheadFrames);
+    }
+
+    AUAudioFrameCount edgePadFrames() const {
+        return std::min(edgePadOverride > 0 ? edgePadOverride : lookaheadFrames(), blockFrames - 1);
+    }
+
+    // Reads the whole signal, writing its zero-phase filtered version in order.
+    bool render(const Reader& read, const Writer& write) {
+        if (channelCount == 0) {
+            return true;
+        }
+
+        const AUAudioFrameCount lookahead = lookaheadFrames();
+        windowCapacity = blockFrames + lookahead;
+        const AUAudioFrameCount windowStride = windowCapacity + edgePadFrames();
+
+        input.assign(size_t(channelCount) * blockFrames, 0.0f);
+        window.assign(size_t(channelCount) * windowStride, 0.0f);
+        output.assign(size_t(channelCount) * windowStride, 0.0f);
+        inputPointers.resize(channelCount);
+        windowPointers.resize(channelCount);
+        outputPointers.resize(channelCount);
+        for (int channel = 0; channel < channelCount; ++channel) {
+            inputPointers[channel] = &input[size_t(channel) * blockFrames];
+            windowPointers[channel] = &window[size_t(channel) * windowStride];
+            outputPointers[channel] = &output[size_t(channel) * windowStride];
+        }
+        forwardStates.assign(channelCount, OfflineBiquadState());
+        windowFill = 0;
+
+        AUAudioFrameCount frames = 0;
+        if (!fill(read, frames)) {
+            return false;
+        }
+        if (frames == 0) {
+            return true;
+        }
+
+        // A short signal can't be reflected further than its own length.
+        const AUAudioFrameCount pad = std::min(edgePadFrames(), frames - 1);
+        primeForward(pad);
+
+        // The last pad + 1 input frames, for the reflection at the end.
+        tail.assign(size_t(channelCount) * (pad + 1), 0.0f);
+
+        while (true) {
+            if (!pushForward(frames, write)) {
+                return false;
+            }
+            updateTail(frames, pad);
+            if (frames < blockFrames) {
+                break;
+            }
+            if (!fill(read, frames)) {
+                return false;
+            }
+            if (frames == 0) {
+                break;
+            }
+        }
+
+        return finish(pad, write);
+    }
+
+private:
+    bool fill(const Reader& read, AUAudioFrameCount& frames) {
+        frames = 0;
+        while (frames < blockFrames) {
+            std::vector<float*> destinations(channelCount);
+            for (int channel = 0; channel < channelCount; ++channel) {
+                destinations[channel] = inputPointers[channel] + frames;
+            }
+            AUAudioFrameCount got = 0;
+            if (!read(destinations.data(), blockFrames - frames, got)) {
+                return false;
+            }
+            if (got == 0) {
+                break;
+            }
+            frames += got;
+        }
+        return true;
+    }
+
+    // Runs the forward filter through the reflection before the first frame.
+    void primeForward(AUAudioFrameCount pad) {
+        std::vector<float> reflection(pad);
+        for (int channel = 0; channel < channelCount; ++channel) {
+            const float* in = inputPointers[channel];
+            for (AUAudioFrameCount i = 0; i < pad; ++i) {
+                reflection[i] = 2.0f * in[0] - in[pad - i];
+            }
+            forwardStates[channel] = steadyBiquadState(coefficients, pad > 0 ? reflection[0] : in[0]);
+            settleBiquad(coefficients, forwardStates[channel], reflection.data(), pad);
+        }
+    }
+
+    bool pushForward(AUAudioFrameCount frames, const Writer& write) {
+        AUAudioFrameCount position = 0;
+        while (position < frames) {
+            AUAudioFrameCount take = std::min(frames - position, windowCapacity - windowFill);
+            for (int channel = 0; channel < channelCount; ++channel) {
+                filterBiquad(coefficients, forwardStates[channel],
+                             inputPointers[channel] + position, windowPointers[channel] + windowFill, take);
+            }
+            windowFill += take;
+            position += take;
+
+            if (windowFill == windowCapacity && !emitBlock(write)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Filters the full window backward, keeps its first block, and slides the lookahead down.
+    bool emitBlock(const Writer& write) {
+        backward(windowCapacity);
+        if (!write(constOutputPointers().data(), blockFrames)) {
+            return false;
+        }
+        for (int channel = 0; channel < channelCount; ++channel) {
+            std::memmove(windowPointers[channel], windowPointers[channel] + blockFrames,
+                         (windowCapacity - blockFrames) * sizeof(float));
+        }
+        windowFill = windowCapacity - blockFrames;
+        return true;
+    }
+
+    void updateTail(AUAudioFrameCount frames, AUAudioFrameCount pad) {
+        AUAudioFrameCount tailFrames = pad + 1;
+        for (int channel = 0; channel < channelCount; ++channel) {
+            float* history = &tail[size_t(channel) * tailFrames];
+            const float* in = inputPointers[channel];
+            if (frames >= tailFrames) {
+                std::memcpy(history, in + frames - tailFrames, tailFrames * sizeof(float));
+            }
+            else {
+                std::memmove(history, history + frames, (tailFrames - frames) * sizeof(float));
+                std::memcpy(history + tailFrames - frames, in, frames * sizeof(float));
+            }
+        }
+    }
+
+    // Extends the forward output through the reflection after the last frame, then flushes the window.
+    bool finish(AUAudioFrameCount pad, const Writer& write) {
+        AUAudioFrameCount tailFrames = pad + 1;
+        std::vector<float> reflection(pad);
+        for (int channel = 0; channel < channelCount; ++channel) {
+            const float* history = &tail[size_t(channel) * tailFrames];
+            float last = history[pad];
+            for (AUAudioFrameCount i = 0; i < pad; ++i) {
+                reflection[i] = 2.0f * last - history[pad - 1 - i];
+            }
+            filterBiquad(coefficients, forwardStates[channel], reflection.data(), windowPointers[channel] + windowFill, pad);
+        }
+
+        backward(windowFill + pad);
+        return windowFill == 0 || write(constOutputPointers().data(), windowFill);
+    }
+
+    void backward(AUAudioFrameCount frames) {
+        for (int channel = 0; channel < channelCount; ++channel) {
+            OfflineBiquadState state = steadyBiquadState(coefficients, windowPointers[channel][frames - 1]);
+            filterBiquadReversed(coefficients, state, windowPointers[channel], outputPointers[channel], frames);
+        }
+    }
+
+    std::vector<const float*> constOutputPointers() const {
+        return std::vector<const float*>(outputPointers.begin(), outputPointers.end());
+    }
+
+    OfflineBiquadCoefficients coefficients;
+    int channelCount = 0;
+    double tolerance = 1.0e-6;
+    AUAudioFrameCount blockFrames = 1 << 18;
+    AUAudioFrameCount edgePadOverride = 0;
+
+    // Render state.
+    AUAudioFrameCount windowCapacity = 0;
+    AUAudioFrameCount windowFill = 0;
+    std::vector<float> input;
+    std::vector<float> window;
+    std::vector<float> output;
+    std::vector<float> tail;
+    std::vector<float*> inputPointers;
+    std::vector<float*> windowPointers;
+    std::vector<float*> outputPointers;
+    std::vector<OfflineBiquadState> forwardStates;
+};
+
+#endif /* OfflineBiquadRenderer_hpp */
@@ -0,0 +1,252 @@
+//
+//  PreciseBiquad.hpp
+//  BiquadFilter
+//
+//  Biquad coefficients designed in double precision, and the two forms the
+//  kernel switches to when single-precision Direct Form I isn't accurate
+//  enough: an error-feedback form that stays in float, and plain double.
+//
+
+#ifndef PreciseBiquad_hpp
+#define PreciseBiquad_hpp
+
+#import <cmath>
+
+#import "DSPKernel.hpp"
+#import "BiquadFilterData.h"
+
+/*
+ PreciseBiquadCoefficients
+ The RBJ cookbook designs, normalized so a0 == 1. Working in double matters
+ at low cutoffs: a1 and a2 approach -2 and 1, and the difference that sets
+ the pole radius is lost if cos(omega) is only known to float precision.
+ */
+struct PreciseBiquadCoefficients {
+    double b0 = 1.0;
+    double b1 = 0.0;
+    double b2 = 0.0;
+    double a1 = 0.0;
+    double a2 = 0.0;
+
+    void calculateCoefficients(double frequency, double resonance,
+                               PARAM_ITEM_FILTER_TYPE filterType,
+                               double sampleRate) {
+        double omega = 2.0 * M_PI * frequency / sampleRate;
+        double sinOmega = sin(omega);
+        double alpha = sinOmega / (2.0 * resonance);
+        double cosOmega = cos(omega);
+
+        double a0 = 1.0;
+
+        switch (filterType) {
+        case PARAM_ITEM_FILTER_TYPE_PASSTHROUGH:
+            b0 = 1.0;
+            b1 = 0.0;
+            b2 = 0.0;
+            a1 = 0.0;
+            a2 = 0.0;
+            break;
+        case PARAM_ITEM_FILTER_TYPE_LOWPASS:
+            b0 = (1.0 - cosOmega) / 2.0;
+            b1 = 1.0 - cosOmega;
+            b2 = (1.0 - cosOmega) / 2.0;
+            a0 = 1.0 + alpha;
+            a1 = -2.0 * cosOmega;
+            a2 = 1.0 - alpha;
+            break;
+        case PARAM_ITEM_FILTER_TYPE_HIGHPASS:
+            b0 = (1.0 + cosOmega) / 2.0;
+            b1 = -(1.0 + cosOmega);
+            b2 = (1.0 + cosOmega) / 2.0;
+            a0 = 1.0 + alpha;
+            a1 = -2.0 * cosOmega;
+            a2 = 1.0 - alpha;
+            break;
+        case PARAM_ITEM_FILTER_TYPE_BANDPASS:
+            b0 = alpha;
+            b1 = 0.0;
+            b2 = -alpha;
+            a0 = 1.0 + alpha;
+            a1 = -2.0 * cosOmega;
+            a2 = 1.0 - alpha;
+            break;
+        case PARAM_ITEM_FILTER_TYPE_NOTCH:
+            b0 = 1.0;
+            b1 = -2.0 * cosOmega;
+            b2 = 1.0;
+            a0 = 1.0 + alpha;
+            a1 = -2.0 * cosOmega;
+            a2 = 1.0 - alpha;
+            break;
+        case PARAM_ITEM_FILTER_TYPE_PEAKINGEQ:
+            {
+                // The same resonance-to-gain fit as KernelBiquadCoefficients.
+                double dbGain = 18.1 * log(resonance) - 8.33;
+                double A = pow(10.0, dbGain / 40.0);
+                b0 = 1.0 + alpha * A;
+                b1 = -2.0 * cosOmega;
+                b2 = 1.0 - alpha * A;
+                a0 = 1.0 + alpha / A;
+                a1 = -2.0 * cosOmega;
+                a2 = 1.0 - alpha / A;
+            }
+            break;
+        }
+        b0 /= a0;
+        b1 /= a0;
+        b2 /= a0;
+        a1 /= a0;
+        a2 /= a0;
+    }
+};
+
+/*
+ The error-feedback form. The recursion runs on an all-pole state s in
+ difference (delta operator) form, and the zeros are applied to s on the way
+ out:
+
+   w  = x - d0 * s[n-1] - q * v[n-1]     second difference of s
+   v  = v[n-1] + w                       first difference of s
+   s  = s[n-1] + v
+   y  = n0 * s + n1 * v + n2 * w
+
+ d0 and q are small and carry their full float precision, so the poles stay
+ where they were designed however close to z = 1 they are. What float loses
+ is in the two accumulations, and those are exact to recover (TwoSum): each
+ one's rounding error is added back into the next sample's update, which is
+ first-order error feedback. The result is within a few dB of double Direct
+ Form I for about twice the arithmetic of float Direct Form I, still in float
+ vectors.
+ */
+struct ErrorFeedbackBiquadCoefficients {
+    float n0 = 1.0;
+    float n1 = 0.0;
+    float n2 = 0.0;
+    float d0 = 1.0;
+    float q = 1.0;
+
+    // The numerator and denominator re-expanded around z = 1, in double.
+    void assign(const PreciseBiquadCoefficients& c) {
+        n0 = float(c.b0 + c.b1 + c.b2);
+        n1 = float(-(c.b1 + 2.0 * c.b2));
+        n2 = float(c.b2);
+        d0 = float(1.0 + c.a1 + c.a2);
+        q = float(1.0 - c.a2);
+    }
+};
+
+struct ErrorFeedbackFilterState {
+    float s1 = 0.0;
+    float v1 = 0.0;
+    float sError = 0.0;
+    float vError = 0.0;
+
+    void clear() {
+        s1 = 0.0;
+        v1 = 0.0;
+        sError = 0.0;
+        vError = 0.0;
+    }
+
+    void convertBadStateValuesToZero() {
+        s1 = convertBadValuesToZero(s1);
+        v1 = convertBadValuesToZero(v1);
+        sError = convertBadValuesToZero(sError);
+        vError = convertBadValuesToZero(vError);
+    }
+};
+
+struct DoubleFilterState {
+    double x1 = 0.0;
+    double x2 = 0.0;
+    double y1 = 0.0;
+    double y2 = 0.0;
+
+    void clear() {
+        x1 = 0.0;
+        x2 = 0.0;
+        y1 = 0.0;
+        y2 = 0.0;
+    }
+
+    void convertBadStateValuesToZero() {
+        x1 = convertBadValuesToZero(x1);
+        x2 = convertBadValuesToZero(x2);
+        y1 = convertBadValuesToZero(y1);
+        y2 = convertBadValuesToZero(y2);
+    }
+};
+
+/*
+ Switching forms mid-stream. Each form is a second-order system, so the first
+ two samples it would ring out with no further input pin its state down. The
+ kernel reads those from the old form and seeds the new one with them, and
+ the output carries on without a click.
+ */
+template <typename State, typename Coefficients>
+static inline void directFormRinging(const State& state, const Coefficients& c, double& r0, double& r1) {
+    r0 = c.b1 * double(state.x1) + c.b2 * double(state.x2) - c.a1 * double(state.y1) - c.a2 * double(state.y2);
+    r1 = c.b2 * double(state.x1) - c.a1 * r0 - c.a2 * double(state.y1);
+}
+
+template <typename State, typename Coefficients>
+static inline void setDirectFormRinging(State& state, const Coefficients& c, double r0, double r1) {
+    typedef decltype(State::y1) Sample;
+    // Silent input history; the past output alone carries the ringing.
+    double a1 = c.a1;
+    double a2 = c.a2;
+    double y1 = 0.0;
+    double y2 = 0.0;
+    if (fabs(a2) > 1e-6) {
+        y1 = -(r1 + a1 * r0) / a2;
+        y2 = -(r0 + a1 * y1) / a2;
+    }
+    else if (fabs(a1) > 1e-6) {
+        // Effectively first order: only the first sample can be matched.
+        y1 = -r0 / a1;
+    }
+    state.x1 = 0.0;
+    state.x2 = 0.0;
+    state.y1 = Sample(y1);
+    state.y2 = Sample(y2);
+}
+
+static inline void errorFeedbackRinging(double s, double v, const ErrorFeedbackBiquadCoefficients& c,
+                                        double& r0, double& r1) {
+    double ringing[2];
+    for (double& r : ringing) {
+        double w = -c.d0 * s - c.q * v;
+        v += w;
+        s += v;
+        r = c.n0 * s + c.n1 * v + c.n2 * w;
+    }
+    r0 = ringing[0];
+    r1 = ringing[1];
+}
+
+static inline void errorFeedbackRinging(const ErrorFeedbackFilterState& state, const ErrorFeedbackBiquadCoefficients& c,
+                                        double& r0, double& r1) {
+    errorFeedbackRinging(double(state.s1) + double(state.sError), double(state.v1) + double(state.vError), c, r0, r1);
+}
+
+static inline void setErrorFeedbackRinging(ErrorFeedbackFilterState& state, const ErrorFeedbackBiquadCoefficients& c,
+                                           double r0, double r1) {
+    // The ringing is linear in (s, v); solve for them.
+    double s0, s1, v0, v1;
+    errorFeedbackRinging(1.0, 0.0, c, s0, s1);
+    errorFeedbackRinging(0.0, 1.0, c, v0, v1);
+    double determinant = s0 * v1 - v0 * s1;
+
+    state.clear();
+    if (!(fabs(determinant) > 1e-30)) {
+        return;
+    }
+    double s = (r0 * v1 - v0 * r1) / determinant;
+    double v = (s0 * r1 - r0 * s1) / determinant;
+    state.s1 = float(s);
+    state.v1 = float(v);
+    state.sError = float(s - double(state.s1));
+    state.vError = float(v - double(state.v1));
+}
+
+#endif /* PreciseBiquad_hpp */
@@ -0,0 +1,390 @@
+//
+//  RenderSessionRecorder.hpp
+//  BiquadFilter
+//
+//  Logs every render callback to a file, so a host session can be replayed
+//  outside the host (see Tools/RenderSessionReplay).
+//
+
+#ifndef RenderSessionRecorder_hpp
+#define RenderSessionRecorder_hpp
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <algorithm>
+#import <atomic>
+#import <chrono>
+#import <cstdint>
+#import <cstdio>
+#import <cstring>
+#import <thread>
+#import <vector>
+
+#import "SPSCRingBuffer.hpp"
+
+/*
+ The session file format. Everything is written in the host's byte order.
+
+ The file starts with a RenderSessionFileHeader, followed by one record per
+ render callback:
+
+   RenderSessionCallback
+   parameterCount AUValues, by address   (only when something changed)
+   controllerCount int32_ts              (only when something changed)
+   eventCount RenderSessionEvents
+   inputChannelCount x frameCount floats, channel by channel
+   sidechainChannelCount x frameCount floats, channel by channel
+
+ The parameters are read from the kernel just before it renders, so they
+ include changes made from the main thread as well as those scheduled as
+ events. So is the MIDI controller map: the parameter each controller
+ moves, then the one a learn is waiting to bind (-1 for none in either).
+ Replaying the parameters, controller map, events and input of each
+ callback reproduces the output exactly, as long as nothing was dropped.
+ A recording started mid-stream matches once the filter state from before
+ it has decayed, since replay starts from silence; MIDI state isn't
+ captured, so start with no keys held and the bend wheel centred.
+ */
+static const char kRenderSessionMagic[4] = { 'B', 'Q', 'R', 'S' };
+static constexpr uint32_t kRenderSessionVersion = 2;
+
+enum {
+    RenderSessionIncludesAudio = 1 << 0,
+};
+
+enum {
+    RenderSessionCallbackBypassed = 1 << 0,
+    // The callback had more events than a record holds; the rest are missing.
+    RenderSessionCallbackEventsTruncated = 1 << 1,
+};
+
+struct RenderSessionFileHeader {
+    char magic[4];
+    uint32_t version;
+    double sampleRate;
+    uint32_t channelCount;
+    uint32_t maximumFrames;
+    uint32_t parameterCount;
+    uint32_t controllerCount;
+    uint32_t flags;
+};
+
+struct RenderSessionCallback {
+    uint32_t recordBytes;           // the whole record, this header included
+    uint32_t frameCount;
+    double sampleTime;
+    uint64_t hostTime;
+    uint32_t eventCount;
+    uint32_t droppedCallbacks;      // callbacks lost just before this one
+    uint16_t flags;
+    uint16_t parameterCount;        // 0 when nothing changed since the last record
+    uint16_t inputChannelCount;
+    uint16_t sidechainChannelCount; // 0 when the sidechain wasn't pulled
+    uint16_t controllerCount;       // 0 when the controller map didn't change
+    uint16_t reserved;
+};
+
+// AURenderEvent with the pointer left out. SysEx keeps its length but not its bytes.
+struct RenderSessionEvent {
+    int64_t sampleTime;
+    uint8_t type;
+    uint8_t cable;
+    uint16_t length;
+    uint32_t rampFrames;
+    uint64_t address;
+    float value;
+    uint8_t data[3];
+    uint8_t reserved;
+};
+
+/*
+ RenderSessionRecorder
+ record() runs on the render thread. It builds each record in preallocated
+ scratch memory and hands it to a ring buffer that a background thread
+ drains to disk, so it never blocks, allocates or touches the file system.
+ A record that doesn't fit is dropped whole and counted; the next record
+ that does fit says how many went missing and repeats the parameters and
+ controller map.
+
+ start() and stop() open and close the file and spawn and join the drain
+ thread. Call them from one thread other than the render thread; they may
+ overlap record().
+ */
+class RenderSessionRecorder {
+public:
+    static constexpr uint32_t maximumEventsPerCallback = 256;
+    // How often the drain thread wakes to write what has accumulated.
+    static constexpr int drainIntervalMilliseconds = 20;
+
+    RenderSessionRecorder() {}
+    RenderSessionRecorder(const RenderSessionRecorder&) = delete;
+    RenderSessionRecorder& operator=(const RenderSessionRecorder&) = delete;
+
+    ~RenderSessionRecorder() {
+        stop();
+    }
+
+    /*
+     Starts a new file at path, ending any recording in progress. Without
+     audio a record is a few dozen bytes; with it, the input makes up almost
+     all of it. Returns false, with errno set, if the file can't be created.
+     */
+    bool start(const char* path, double sampleRate, int channelCount, AUAudioFrameCount maximumFrames,
+               int parameterCount, int controllerCount, bool includeAudio) {
+        stop();
+
+        file = std::fopen(path, "wb");
+        if (file == nullptr) {
+            return false;
+        }
+
+        RenderSessionFileHeader header = {};
+        std::memcpy(header.magic, kRenderSessionMagic, sizeof(header.magic));
+        header.version = kRenderSessionVersion;
+        header.sampleRate = sampleRate;
+        header.channelCount = uint32_t(channelCount);
+        header.maximumFrames = maximumFrames;
+        header.parameterCount = uint32_t(parameterCount);
+        header.controllerCount = uint32_t(controllerCount);
+        header.flags = includeAudio ? RenderSessionIncludesAudio : 0;
+        writeFailed = std::fwrite(&header, sizeof(header), 1, file) != 1;
+
+        channels = channelCount;
+        maximumFramesPerCallback = maximumFrames;
+        parameters = parameterCount;
+        controllers = controllerCount;
+        audio = includeAudio;
+
+        size_t audioBytes = includeAudio ? size_t(2 * channelCount) * maximumFrames * sizeof(float) : 0;
+        size_t recordCapacity = sizeof(RenderSessionCallback)
+                              + size_t(parameterCount) * sizeof(AUValue)
+                              + size_t(controllerCount) * sizeof(int32_t)
+                              + maximumEventsPerCallback * sizeof(RenderSessionEvent)
+                              + audioBytes;
+        scratch.assign(recordCapacity, 0);
+        lastParameters.assign(size_t(parameterCount), 0.0f);
+        lastControllers.assign(size_t(controllerCount), 0);
+
+        // Room for half a second of audio, so a slow disk doesn't cost records.
+        size_t ringBytes = 16 * recordCapacity;
+        size_t halfSecond = size_t(0.5 * sampleRate) * size_t(channelCount) * sizeof(float) * (includeAudio ? 2 : 0);
+        if (ringBytes < halfSecond) {
+            ringBytes = halfSecond;
+        }
+        ring.allocate(ringBytes);
+
+        hasLastParameters = false;
+        droppedSinceLastRecord = 0;
+        droppedTotal.store(0, std::memory_order_relaxed);
+        recordedTotal.store(0, std::memory_order_relaxed);
+
+        draining.store(true, std::memory_order_relaxed);
+        drainThread = std::thread([this] { drainLoop(); });
+
+        // Publishes everything above to the render thread.
+        recording.store(true, std::memory_order_seq_cst);
+        return true;
+    }
+
+    // Waits for the file to be complete. Returns false if any of it couldn't be written.
+    bool stop() {
+        if (!drainThread.joinable()) {
+            return true;
+        }
+
+        recording.store(false, std::memory_order_seq_cst);
+        // A record() that saw recording set may still be writing into the ring.
+        while (writerBusy.load(std::memory_order_seq_cst)) {
+            std::this_thread::yield();
+        }
+
+        draining.store(false, std::memory_order_release);
+        drainThread.join();
+
+        bool closed = std::fclose(file) == 0;
+        file = nullptr;
+        return closed && !writeFailed;
+    }
+
+    bool isRecording() const {
+        return recording.load(std::memory_order_relaxed);
+    }
+
+    uint64_t droppedCallbacks() const {
+        return droppedTotal.load(std::memory_order_relaxed);
+    }
+
+    uint64_t recordedCallbacks() const {
+        return recordedTotal.load(std::memory_order_relaxed);
+    }
+
+    /*
+     Render thread. Call with the input pulled but not yet processed, so an
+     in-place render hasn't overwritten it. parameterValues holds the
+     kernel's current values for addresses [0, parameterCount), and
+     controllerAddresses its controller map, as described above. sidechain
+     may be null.
+     */
+    void record(const AudioTimeStamp* timestamp, AUAudioFrameCount frameCount, const AURenderEvent* events,
+                const AudioBufferList* input, const AudioBufferList* sidechain, bool bypassed,
+                const AUValue* parameterValues, const int32_t* controllerAddresses) {
+        if (!recording.load(std::memory_order_acquire)) {
+            return;
+        }
+        // Paired with stop(): either it sees us busy, or we see it has stopped.
+        writerBusy.store(true, std::memory_order_seq_cst);
+        if (recording.load(std::memory_order_seq_cst) && frameCount <= maximumFramesPerCallback) {
+            writeRecord(timestamp, frameCount, events, input, sidechain, bypassed, parameterValues, controllerAddresses);
+        }
+        writerBusy.store(false, std::memory_order_release);
+    }
+
+private:
+    void writeRecord(const AudioTimeStamp* timestamp, AUAudioFrameCount frameCount, const AURenderEvent* events,
+                     const AudioBufferList* input, const AudioBufferList* sidechain, bool bypassed,
+                     const AUValue* parameterValues, const int32_t* controllerAddresses) {
+        uint8_t* cursor = scratch.data() + sizeof(RenderSessionCallback);
+
+        RenderSessionCallback callback = {};
+        callback.frameCount = frameCount;
+        callback.sampleTime = timestamp != nullptr ? timestamp->mSampleTime : 0.0;
+        callback.hostTime = timestamp != nullptr ? timestamp->mHostTime : 0;
+        callback.droppedCallbacks = droppedSinceLastRecord;
+        callback.flags = bypassed ? RenderSessionCallbackBypassed : 0;
+
+        bool parametersChanged = !hasLastParameters
+            || std::memcmp(parameterValues, lastParameters.data(), parameters * sizeof(AUValue)) != 0;
+        if (parametersChanged) {
+            callback.parameterCount = uint16_t(parameters);
+            std::memcpy(cursor, parameterValues, parameters * sizeof(AUValue));
+            cursor += parameters * sizeof(AUValue);
+        }
+        bool controllersChanged = !hasLastParameters
+            || std::memcmp(controllerAddresses, lastControllers.data(), controllers * sizeof(int32_t)) != 0;
+        if (controllersChanged) {
+            callback.controllerCount = uint16_t(controllers);
+            std::memcpy(cursor, controllerAddresses, controllers * sizeof(int32_t));
+            cursor += controllers * sizeof(int32_t);
+        }
+
+        for (const AURenderEvent* event = events; event != nullptr; event = event->head.next) {
+            if (callback.eventCount == maximumEventsPerCallback) {
+                callback.flags |= RenderSessionCallbackEventsTruncated;
+                break;
+            }
+            RenderSessionEvent recorded = {};
+            recorded.sampleTime = event->head.eventSampleTime;
+            recorded.type = uint8_t(event->head.eventType);
+            switch (event->head.eventType) {
+                case AURenderEventParameter:
+                case AURenderEventParameterRamp:
+                    recorded.rampFrames = event->parameter.rampDurationSampleFrames;
+                    recorded.address = event->parameter.parameterAddress;
+                    recorded.value = event->parameter.value;
+                    break;
+                case AURenderEventMIDI:
+                case AURenderEventMIDISysEx:
+                    recorded.cable = event->MIDI.cable;
+                    recorded.length = event->MIDI.length;
+                    if (event->head.eventType == AURenderEventMIDI) {
+                        std::memcpy(recorded.data, event->MIDI.data, sizeof(recorded.data));
+                    }
+                    break;
+                default:
+                    break;
+            }
+            std::memcpy(cursor, &recorded, sizeof(recorded));
+            cursor += sizeof(recorded);
+            ++callback.eventCount;
+        }
+
+        if (audio) {
+            callback.inputChannelCount = uint16_t(copyAudio(cursor, input, frameCount));
+            callback.sidechainChannelCount = uint16_t(copyAudio(cursor, sidechain, frameCount));
+        }
+
+        size_t recordBytes = size_t(cursor - scratch.data());
+        callback.recordBytes = uint32_t(recordBytes);
+        std::memcpy(scratch.data(), &callback, sizeof(callback));
+
+        if (ring.availableToWrite() < recordBytes) {
+            ++droppedSinceLastRecord;
+            droppedTotal.fetch_add(1, std::memory_order_relaxed);
+            // The parameters and map only go out when they change, so repeat them after a gap.
+            hasLastParameters = false;
+            return;
+        }
+
+        ring.write(scratch.data(), recordBytes);
+        droppedSinceLastRecord = 0;
+        recordedTotal.fetch_add(1, std::memory_order_relaxed);
+        if (parametersChanged) {
+            std::memcpy(lastParameters.data(), parameterValues, parameters * sizeof(AUValue));
+        }
+        if (controllersChanged) {
+            std::memcpy(lastControllers.data(), controllerAddresses, controllers * sizeof(int32_t));
+        }
+        hasLastParameters = true;
+    }
+
+    // Appends up to the session's channel count; returns the number of channels copied.
+    int copyAudio(uint8_t*& cursor, const AudioBufferList* bufferList, AUAudioFrameCount frameCount) {
+        if (bufferList == nullptr) {
+            return 0;
+        }
+        int channelCount = std::min(int(bufferList->mNumberBuffers), channels);
+        size_t bytes = frameCount * sizeof(float);
+        for (int channel = 0; channel < channelCount; ++channel) {
+            std::memcpy(cursor, bufferList->mBuffers[channel].mData, bytes);
+            cursor += bytes;
+        }
+        return channelCount;
+    }
+
+    void drainLoop() {
+        std::vector<uint8_t> buffer(1 << 16);
+        while (true) {
+            // Read the flag first so nothing written before stop() is left behind.
+            bool finishing = !draining.load(std::memory_order_acquire);
+            size_t count;
+            while ((count = ring.read(buffer.data(), buffer.size())) > 0) {
+                if (!writeFailed && std::fwrite(buffer.data(), 1, count, file) != count) {
+                    writeFailed = true;
+                }
+            }
+            if (finishing) {
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(int(drainIntervalMilliseconds)));
+        }
+    }
+
+    // Set up by start() before recording is published.
+    int channels = 0;
+    AUAudioFrameCount maximumFramesPerCallback = 0;
+    size_t parameters = 0;
+    size_t controllers = 0;
+    bool audio = false;
+    std::vector<uint8_t> scratch;
+
+    // Render thread only.
+    std::vector<AUValue> lastParameters;
+    std::vector<int32_t> lastControllers;
+    // Whether the last record written leaves both of the above to compare against.
+    bool hasLastParameters = false;
+    uint32_t droppedSinceLastRecord = 0;
+
+    SPSCRingBuffer<uint8_t> ring;
+
+    // Drain thread only, between start() and stop().
+    std::FILE* file = nullptr;
+    bool writeFailed = false;
+    std::thread drainThread;
+
+    std::atomic<bool> recording { false };
+    std::atomic<bool> writerBusy { false };
+    std::atomic<bool> draining { false };
+    std::atomic<uint64_t> droppedTotal { 0 };
+    std::atomic<uint64_t> recordedTotal { 0 };
+};
+
+#endif /* RenderSessionRecorder_hpp */
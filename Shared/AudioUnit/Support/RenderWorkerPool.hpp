@@ -0,0 +1,518 @@
+//
+//  RenderWorkerPool.hpp
+//  BiquadFilter
+//
+//  Pre-spawned real-time threads that help the render thread through a
+//  callback's worth of independent work.
+//
+
+#ifndef RenderWorkerPool_hpp
+#define RenderWorkerPool_hpp
+
+#import <algorithm>
+#import <atomic>
+#import <cerrno>
+#import <chrono>
+#import <cstdint>
+#import <memory>
+#import <thread>
+#import <vector>
+
+#import <pthread.h>
+#if defined(__APPLE__)
+#import <mach/mach.h>
+#import <mach/mach_time.h>
+#import <mach/thread_policy.h>
+#if __has_include(<os/workgroup.h>)
+#import <os/workgroup.h>
+#define RENDER_WORKER_POOL_WORKGROUPS 1
+#endif
+#else
+#import <sched.h>
+#import <semaphore.h>
+#endif
+
+#import "AlignedStateStore.hpp"
+
+// A hint to the core that this is a spin-wait loop.
+static inline void spinPause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/*
+ WorkerSemaphore
+ Where a parked worker sleeps. Signalling it is a single kernel trap that
+ never blocks, so the render thread may do it.
+ */
+class WorkerSemaphore {
+public:
+    WorkerSemaphore() {
+#if defined(__APPLE__)
+        semaphore_create(mach_task_self(), &semaphore, SYNC_POLICY_FIFO, 0);
+#else
+        sem_init(&semaphore, 0, 0);
+#endif
+    }
+
+    ~WorkerSemaphore() {
+#if defined(__APPLE__)
+        semaphore_destroy(mach_task_self(), semaphore);
+#else
+        sem_destroy(&semaphore);
+#endif
+    }
+
+    WorkerSemaphore(const WorkerSemaphore&) = delete;
+    WorkerSemaphore& operator=(const WorkerSemaphore&) = delete;
+
+    void signal() {
+#if defined(__APPLE__)
+        semaphore_signal(semaphore);
+#else
+        sem_post(&semaphore);
+#endif
+    }
+
+    void wait() {
+#if defined(__APPLE__)
+        while (semaphore_wait(semaphore) == KERN_ABORTED) {}
+#else
+        while (sem_wait(&semaphore) == -1 && errno == EINTR) {}
+#endif
+    }
+
+private:
+#if defined(__APPLE__)
+    semaphore_t semaphore;
+#else
+    sem_t semaphore;
+#endif
+};
+
+/*
+ RenderWorkerPool
+ run() splits a job into groups and returns once every group is done. The
+ calling (render) thread works through groups alongside the workers, so a
+ worker that is slow to wake costs nothing: the render thread simply takes
+ its share.
+
+ The job is published as one 64-bit word holding a generation, the group
+ count and the next unclaimed group. Claiming a group is a compare-and-swap
+ on that word, so a worker still finishing an old generation can never claim
+ a group of a newer one by mistake. Between jobs, workers spin for a short
+ while (render callbacks come back quickly) and then park on a semaphore;
+ run() only signals workers that actually parked. How many pauses make up
+ that while is measured at start(), since a pause costs anywhere from a few
+ to well over a hundred cycles depending on the core.
+
+ On Apple platforms the workers also join the host's audio workgroup,
+ handed over by setWorkgroup(). The render thread waits for groups a worker
+ has claimed, so a worker descheduled mid-group stalls it; in the workgroup
+ the scheduler knows the two are working to the same deadline. Without one
+ (older systems, or a host that doesn't provide it) the workers get by on
+ their time-constraint policy alone.
+
+ start() and stop() spawn and join the threads. They aren't real-time safe
+ and must not overlap run() or setWorkgroup().
+ */
+class RenderWorkerPool {
+public:
+    typedef void (*GroupFunction)(void* context, int group);
+
+    static constexpr int maximumWorkerCount = 16;
+    static constexpr int maximumGroupCount = 0xFFFF;
+    /*
+     How long a worker spins before it parks. Within a callback, one control
+     period's job follows the last after a few microseconds of serial work,
+     and this covers that with room to spare; it's still a small fraction
+     of even a 32-frame callback, so a worker idle between callbacks wastes
+     little.
+     */
+    static constexpr double spinNanoseconds = 30000.0;
+
+    RenderWorkerPool() {}
+    RenderWorkerPool(const RenderWorkerPool&) = delete;
+    RenderWorkerPool& operator=(const RenderWorkerPool&) = delete;
+
+    ~RenderWorkerPool() {
+        stop();
+#if RENDER_WORKER_POOL_WORKGROUPS
+        releaseWorkgroup(workgroup);
+#endif
+    }
+
+    /*
+     Spawns inWorkerCount threads at real-time priority, scheduled for a
+     callback of maximumFrames at sampleRate. Replaces any running workers;
+     zero just stops them.
+     */
+    void start(int inWorkerCount, double sampleRate, AUAudioFrameCount maximumFrames) {
+        stop();
+
+        // More workers than spare cores would only preempt one another.
+        int spareCores = int(std::thread::hardware_concurrency()) - 1;
+        if (inWorkerCount > spareCores) {
+            inWorkerCount = spareCores;
+        }
+        if (inWorkerCount > maximumWorkerCount) {
+            inWorkerCount = maximumWorkerCount;
+        }
+        if (inWorkerCount <= 0) {
+            return;
+        }
+
+        double periodNanoseconds = 1.0e9 * double(std::max(maximumFrames, AUAudioFrameCount(1))) / std::max(sampleRate, 1.0);
+        spinIterations = int(std::min(std::max(spinNanoseconds / measurePauseNanoseconds(), 64.0), 1048576.0));
+
+        running.store(true, std::memory_order_release);
+        for (int i = 0; i < inWorkerCount; ++i) {
+            workers.emplace_back(new Worker());
+        }
+#if RENDER_WORKER_POOL_WORKGROUPS
+        if (workgroup != nullptr) {
+            postWorkgroup();
+        }
+#endif
+        for (auto& worker : workers) {
+            Worker* w = worker.get();
+            w->thread = std::thread([this, w, periodNanoseconds] {
+                setRealtimePriority(periodNanoseconds);
+                workerLoop(*w);
+            });
+        }
+    }
+
+    void stop() {
+        if (workers.empty()) {
+            return;
+        }
+
+        running.store(false, std::memory_order_release);
+        publish(0);
+        wakeParkedWorkers();
+
+        for (auto& worker : workers) {
+            worker->thread.join();
+        }
+        workers.clear();
+    }
+
+    // Safe to call from the render thread.
+    int workerCount() const {
+        return int(workers.size());
+    }
+
+    int spinIterationCount() const {
+        return spinIterations;
+    }
+
+#if RENDER_WORKER_POOL_WORKGROUPS
+    /*
+     Render thread, from the host's render context observer. Each worker
+     leaves the workgroup it's in and joins this one (none, if it's null) the
+     next time it wakes; parked workers are woken for it. Kept across
+     start() and stop(), so workers spawned later join it too.
+     */
+    void setWorkgroup(os_workgroup_t newWorkgroup) {
+        releaseWorkgroup(workgroup);
+        workgroup = retainWorkgroup(newWorkgroup);
+        postWorkgroup();
+        wakeParkedWorkers();
+    }
+#endif
+
+    /*
+     What sharing out a job costs beyond the work itself: the median time
+     run() takes for one group per thread, each group a fixed couple of
+     microseconds of work, less that work. Workers are awake, as they are
+     for every period of a callback after the first. Not real-time safe;
+     call after start(), never alongside run().
+     */
+    double measureHandoffNanoseconds() {
+        if (workers.empty()) {
+            return 0.0;
+        }
+        const int warmupRounds = 20;
+        const int rounds = 201;
+        std::vector<double> timings;
+        timings.reserve(rounds);
+        for (int round = -warmupRounds; round < rounds; ++round) {
+            auto start = std::chrono::steady_clock::now();
+            run(&busyGroup, nullptr, workerCount() + 1);
+            double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            if (round >= 0) {
+                timings.push_back(elapsed);
+            }
+        }
+        std::nth_element(timings.begin(), timings.begin() + rounds / 2, timings.end());
+        return std::max(timings[rounds / 2] - busyGroupNanoseconds, 0.0);
+    }
+
+    /*
+     Render thread. Calls function(context, group) once for each group in
+     [0, groupCount), spread across the render thread and the workers, and
+     returns when all of them have finished. Without workers it's a plain
+     loop.
+     */
+    void run(GroupFunction function, void* context, int groupCount) {
+        if (groupCount > maximumGroupCount) {
+            groupCount = maximumGroupCount;
+        }
+        if (workers.empty() || groupCount <= 1) {
+            for (int group = 0; group < groupCount; ++group) {
+                function(context, group);
+            }
+            return;
+        }
+
+        // Nobody reads these until the publish below, and nobody can still be
+        // reading the previous job's, because its groups have all completed.
+        jobFunction = function;
+        jobContext = context;
+        completedGroups.store(0, std::memory_order_relaxed);
+
+        uint32_t current = publish(groupCount);
+        wakeParkedWorkers();
+
+        drain(current);
+
+        while (completedGroups.load(std::memory_order_acquire) < groupCount) {
+            spinPause();
+        }
+    }
+
+private:
+    struct Worker {
+        std::thread thread;
+        WorkerSemaphore semaphore;
+        std::atomic<bool> parked { false };
+#if RENDER_WORKER_POOL_WORKGROUPS
+        // A retained workgroup to move to, or leaveMarker(); posted by setWorkgroup().
+        std::atomic<void*> nextWorkgroup { nullptr };
+        // Worker thread only.
+        void* joinedWorkgroup = nullptr;
+        os_workgroup_join_token_s joinToken;
+#endif
+    };
+
+    static constexpr double busyGroupNanoseconds = 2000.0;
+
+    static void busyGroup(void*, int) {
+        auto end = std::chrono::steady_clock::now() + std::chrono::nanoseconds(int64_t(busyGroupNanoseconds));
+        while (std::chrono::steady_clock::now() < end) {}
+    }
+
+    static double measurePauseNanoseconds() {
+        const int pauses = 20000;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < pauses; ++i) {
+            spinPause();
+        }
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        return std::max(elapsed / pauses, 0.1);
+    }
+
+    static uint64_t pack(uint32_t generation, int groupCount, int nextGroup) {
+        return (uint64_t(generation) << 32) | (uint64_t(groupCount) << 16) | uint64_t(nextGroup);
+    }
+    static uint32_t generationOf(uint64_t word) { return uint32_t(word >> 32); }
+    static int groupCountOf(uint64_t word) { return int((word >> 16) & 0xFFFF); }
+    static int nextGroupOf(uint64_t word) { return int(word & 0xFFFF); }
+
+    // Starts a new generation. Only run() and stop() call this.
+    uint32_t publish(int groupCount) {
+        ++generation;
+        // Sequentially consistent, paired with the parked flag in workerLoop().
+        work.store(pack(generation, groupCount, 0), std::memory_order_seq_cst);
+        return generation;
+    }
+
+    void wakeParkedWorkers() {
+        for (auto& worker : workers) {
+            if (worker->parked.exchange(false, std::memory_order_seq_cst)) {
+                worker->semaphore.signal();
+            }
+        }
+    }
+
+    // Claims and runs groups of the given generation until there are none left.
+    void drain(uint32_t expectedGeneration) {
+        uint64_t word = work.load(std::memory_order_acquire);
+        while (generationOf(word) == expectedGeneration && nextGroupOf(word) < groupCountOf(word)) {
+            if (!work.compare_exchange_weak(word, word + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                continue;
+            }
+            jobFunction(jobContext, nextGroupOf(word));
+            completedGroups.fetch_add(1, std::memory_order_release);
+            word = work.load(std::memory_order_acquire);
+        }
+    }
+
+    void workerLoop(Worker& worker) {
+        uint32_t seen = 0;
+        adoptWorkgroup(worker);
+        while (true) {
+            uint64_t word = work.load(std::memory_order_acquire);
+            int spins = 0;
+            while (generationOf(word) == seen) {
+                if (++spins < spinIterations) {
+                    spinPause();
+                }
+                else {
+                    // Announce the park, then look once more so a publish can't slip past.
+                    worker.parked.store(true, std::memory_order_seq_cst);
+                    word = work.load(std::memory_order_seq_cst);
+                    if (generationOf(word) != seen && worker.parked.exchange(false, std::memory_order_seq_cst)) {
+                        break;
+                    }
+                    // Either nothing new yet, or run() cleared the flag and is signalling.
+                    worker.semaphore.wait();
+                    adoptWorkgroup(worker);
+                    spins = 0;
+                }
+                word = work.load(std::memory_order_acquire);
+            }
+
+            if (!running.load(std::memory_order_acquire)) {
+                leaveWorkgroup(worker);
+                return;
+            }
+            seen = generationOf(word);
+            adoptWorkgroup(worker);
+            drain(seen);
+        }
+    }
+
+    /*
+     Workers need the same scheduling class as the render thread, or they'd
+     be preempted just when they're needed. Failure is harmless: the render
+     thread picks up whatever the workers don't get to.
+     */
+    static void setRealtimePriority(double periodNanoseconds) {
+#if defined(__APPLE__)
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        double ticksPerNanosecond = double(timebase.denom) / double(timebase.numer);
+
+        thread_time_constraint_policy_data_t policy;
+        policy.period = uint32_t(periodNanoseconds * ticksPerNanosecond);
+        policy.computation = uint32_t(0.5 * periodNanoseconds * ticksPerNanosecond);
+        policy.constraint = policy.period;
+        policy.preemptible = true;
+        thread_policy_set(pthread_mach_thread_np(pthread_self()),
+                          THREAD_TIME_CONSTRAINT_POLICY,
+                          (thread_policy_t)&policy,
+                          THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+#else
+        (void)periodNanoseconds;
+        sched_param parameter;
+        parameter.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+        pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameter);
+#endif
+    }
+
+#if RENDER_WORKER_POOL_WORKGROUPS
+    /*
+     Workgroups cross threads as retained, untyped pointers. The render
+     thread takes a reference for each worker it posts one to, and the worker
+     drops it once it has left, so a workgroup the host has moved on from is
+     normally freed off the render thread.
+     */
+    static void* retainWorkgroup(os_workgroup_t newWorkgroup) {
+#if __has_feature(objc_arc)
+        return (__bridge_retained void*)newWorkgroup;
+#else
+        return newWorkgroup != nullptr ? os_retain(newWorkgroup) : nullptr;
+#endif
+    }
+
+    static void releaseWorkgroup(void* handle) {
+        if (handle == nullptr || handle == leaveMarker()) {
+            return;
+        }
+#if __has_feature(objc_arc)
+        os_workgroup_t released = (__bridge_transfer os_workgroup_t)handle;
+        (void)released;
+#else
+        os_release(handle);
+#endif
+    }
+
+    static os_workgroup_t workgroupOf(void* handle) {
+#if __has_feature(objc_arc)
+        return (__bridge os_workgroup_t)handle;
+#else
+        return (os_workgroup_t)handle;
+#endif
+    }
+
+    static void* leaveMarker() {
+        static char marker;
+        return &marker;
+    }
+
+    void postWorkgroup() {
+        for (auto& worker : workers) {
+            void* next = workgroup != nullptr ? retainWorkgroup(workgroupOf(workgroup)) : leaveMarker();
+            // One the worker never got round to.
+            releaseWorkgroup(worker->nextWorkgroup.exchange(next, std::memory_order_acq_rel));
+        }
+    }
+
+    // Worker thread. Moves to whatever setWorkgroup() last posted, if anything.
+    static void adoptWorkgroup(Worker& worker) {
+        if (worker.nextWorkgroup.load(std::memory_order_relaxed) == nullptr) {
+            return;
+        }
+        void* next = worker.nextWorkgroup.exchange(nullptr, std::memory_order_acq_rel);
+        if (next == nullptr) {
+            return;
+        }
+        if (__builtin_available(macOS 11.0, iOS 14.0, *)) {
+            if (worker.joinedWorkgroup != nullptr) {
+                os_workgroup_leave(workgroupOf(worker.joinedWorkgroup), &worker.joinToken);
+                releaseWorkgroup(worker.joinedWorkgroup);
+                worker.joinedWorkgroup = nullptr;
+            }
+            // Fails if the host has already cancelled it; the worker carries on outside.
+            if (next != leaveMarker() && os_workgroup_join(workgroupOf(next), &worker.joinToken) == 0) {
+                worker.joinedWorkgroup = next;
+                return;
+            }
+        }
+        releaseWorkgroup(next);
+    }
+
+    static void leaveWorkgroup(Worker& worker) {
+        releaseWorkgroup(worker.nextWorkgroup.exchange(leaveMarker(), std::memory_order_acq_rel));
+        adoptWorkgroup(worker);
+    }
+#else
+    static void adoptWorkgroup(Worker&) {}
+    static void leaveWorkgroup(Worker&) {}
+#endif
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> running { false };
+    int spinIterations = 2000;  // set by start() before the workers exist
+    uint32_t generation = 0;    // render thread only
+#if RENDER_WORKER_POOL_WORKGROUPS
+    void* workgroup = nullptr;  // retained; render thread, or start() and stop()
+#endif
+
+    GroupFunction jobFunction = nullptr;
+    void* jobContext = nullptr;
+
+    // The word the workers poll, and the counter run() polls, on lines of their own.
+    char padding0[kCacheLineSize];
+    std::atomic<uint64_t> work { 0 };
+    char padding1[kCacheLineSize - sizeof(std::atomic<uint64_t>)];
+    std::atomic<int> completedGroups { 0 };
+    char padding2[kCacheLineSize - sizeof(std::atomic<int>)];
+};
+
+#endif /* RenderWorkerPool_hpp */
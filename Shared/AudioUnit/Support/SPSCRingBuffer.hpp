@@ -0,0 +1,118 @@
+//
+//  SPSCRingBuffer.hpp
+//  BiquadFilter
+//
+//  A lock-free single-producer/single-consumer ring buffer.
+//
+
+#ifndef SPSCRingBuffer_hpp
+#define SPSCRingBuffer_hpp
+
+#import <algorithm>
+#import <atomic>
+#import <cstring>
+#import <vector>
+
+#import "AlignedStateStore.hpp"
+
+/*
+ SPSCRingBuffer
+ One thread writes, one other thread reads; neither ever blocks or allocates.
+ The producer (normally the render thread) drops whatever doesn't fit rather
+ than waiting for the consumer.
+
+ allocate() must happen before either side starts and isn't thread safe.
+ */
+template <typename T>
+class SPSCRingBuffer {
+public:
+    // Rounds capacity up to a power of two so indices wrap with a mask.
+    void allocate(size_t minimumCapacity) {
+        size_t capacity = 1;
+        while (capacity < minimumCapacity) {
+            capacity <<= 1;
+        }
+        storage.assign(capacity, T());
+        mask = capacity - 1;
+        writeIndex.store(0, std::memory_order_relaxed);
+        readIndex.store(0, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const {
+        return storage.size();
+    }
+
+    // Producer side. Returns the number of items actually written.
+    size_t write(const T* items, size_t count) {
+        size_t write = writeIndex.load(std::memory_order_relaxed);
+        size_t read = readIndex.load(std::memory_order_acquire);
+        count = std::min(count, storage.size() - (write - read));
+        if (count == 0) {
+            return 0;
+        }
+
+        copyIn(write, items, count);
+        writeIndex.store(write + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side. Returns the number of items actually read.
+    size_t read(T* items, size_t count) {
+        size_t read = readIndex.load(std::memory_order_relaxed);
+        size_t write = writeIndex.load(std::memory_order_acquire);
+        count = std::min(count, write - read);
+        if (count == 0) {
+            return 0;
+        }
+
+        copyOut(read, items, count);
+        readIndex.store(read + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side. Discards everything currently readable.
+    void clear() {
+        readIndex.store(writeIndex.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    // Either side; the value may be stale by the time the caller uses it.
+    size_t availableToRead() const {
+        return writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire);
+    }
+
+    // Producer side. Never less than what the next write() can take.
+    size_t availableToWrite() const {
+        return storage.size() - (writeIndex.load(std::memory_order_relaxed) - readIndex.load(std::memory_order_acquire));
+    }
+
+private:
+    void copyIn(size_t index, const T* items, size_t count) {
+        size_t start = index & mask;
+        size_t firstPart = std::min(count, storage.size() - start);
+        std::memcpy(&storage[start], items, firstPart * sizeof(T));
+        std::memcpy(&storage[0], items + firstPart, (count - firstPart) * sizeof(T));
+    }
+
+    void copyOut(size_t index, T* items, size_t count) const {
+        size_t start = index & mask;
+        size_t firstPart = std::min(count, storage.size() - start);
+        std::memcpy(items, &storage[start], firstPart * sizeof(T));
+        std::memcpy(items + firstPart, &storage[0], (count - firstPart) * sizeof(T));
+    }
+
+    std::vector<T> storage;
+    size_t mask = 0;
+
+    /*
+     Keep the two indices on separate cache lines so the threads don't contend.
+     Padding rather than alignas, because the owning kernel lives inside an
+     Objective-C object and C++14 can't over-align heap allocations.
+     */
+    char padding0[kCacheLineSize];
+    std::atomic<size_t> writeIndex { 0 };
+    char padding1[kCacheLineSize - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> readIndex { 0 };
+    char padding2[kCacheLineSize - sizeof(std::atomic<size_t>)];
+};
+
+#endif /* SPSCRingBuffer_hpp */
@@ -0,0 +1,129 @@
+//
+//  StateVariableFilter.hpp
+//  BiquadFilter
+//
+//  A topology-preserving-transform (TPT) state-variable filter, after
+//  Zavalishin and Simper. It offers the same responses as the Direct Form I
+//  biquad, but its state stays well behaved when the cutoff moves every
+//  sample.
+//
+
+#ifndef StateVariableFilter_hpp
+#define StateVariableFilter_hpp
+
+#import <cmath>
+
+#import "DSPKernel.hpp"
+#import "BiquadFilterData.h"
+
+/*
+ TanTable
+ tan(pi * x) for normalized frequencies x = cutoff / sampleRate, so a new
+ cutoff costs one interpolated lookup instead of a tan(). The kernel looks
+ up g once per control period and glides it linearly across the period
+ (see FilterDSPKernel::prepareStateVariable); it isn't looked up per sample.
+ */
+class TanTable {
+public:
+    static constexpr int size = 2048;
+    static constexpr float maximumNormalizedFrequency = 0.49f;
+
+    TanTable() {
+        for (int i = 0; i <= size; ++i) {
+            table[i] = float(tan(M_PI * maximumNormalizedFrequency * double(i) / double(size)));
+        }
+    }
+
+    float lookup(float normalizedFrequency) const {
+        float position = normalizedFrequency * (float(size) / maximumNormalizedFrequency);
+        position = std::min(std::max(position, 0.0f), float(size) - 1.0f);
+        int index = int(position);
+        float fraction = position - float(index);
+        return table[index] + fraction * (table[index + 1] - table[index]);
+    }
+
+private:
+    float table[size + 1];
+};
+
+struct StateVariableFilterState {
+    float ic1eq = 0.0;
+    float ic2eq = 0.0;
+
+    void clear() {
+        ic1eq = 0.0;
+        ic2eq = 0.0;
+    }
+
+    void convertBadStateValuesToZero() {
+        ic1eq = convertBadValuesToZero(ic1eq);
+        ic2eq = convertBadValuesToZero(ic2eq);
+    }
+};
+
+/*
+ StateVariableFilterCoefficients
+ The output is m0 * input + m1 * band + m2 * low. The mix and damping only
+ depend on resonance and filter type, so they're recalculated only when those
+ change; the cutoff-dependent part is setCutoff(), which is cheap enough to
+ call every sample, and is while g glides across a control period.
+ */
+struct StateVariableFilterCoefficients {
+    float a1 = 1.0;
+    float a2 = 0.0;
+    float a3 = 0.0;
+    float k = 1.0;
+    float m0 = 1.0;
+    float m1 = 0.0;
+    float m2 = 0.0;
+
+    // Matches the Direct Form I coefficients, including the peaking EQ's Q-to-gain fit.
+    void setResponse(float resonance, PARAM_ITEM_FILTER_TYPE filterType) {
+        k = 1.0 / resonance;
+
+        switch (filterType) {
+        case PARAM_ITEM_FILTER_TYPE_PASSTHROUGH:
+            m0 = 1.0; m1 = 0.0; m2 = 0.0;
+            break;
+        case PARAM_ITEM_FILTER_TYPE_LOWPASS:
+            m0 = 0.0; m1 = 0.0; m2 = 1.0;
+            break;
+        case PARAM_ITEM_FILTER_TYPE_HIGHPASS:
+            m0 = 1.0; m1 = -k; m2 = -1.0;
+            break;
+        case PARAM_ITEM_FILTER_TYPE_BANDPASS:
+            // Constant 0 dB peak gain, like the biquad's b0 = alpha.
+            m0 = 0.0; m1 = k; m2 = 0.0;
+            break;
+        case PARAM_ITEM_FILTER_TYPE_NOTCH:
+            m0 = 1.0; m1 = -k; m2 = 0.0;
+            break;
+        case PARAM_ITEM_FILTER_TYPE_PEAKINGEQ:
+            {
+                float dbGain = 18.1 * log(resonance) - 8.33;
+                float A = pow(10.0, dbGain / 40.0);
+                k = 1.0 / (resonance * A);
+                m0 = 1.0; m1 = k * (A * A - 1.0); m2 = 0.0;
+            }
+            break;
+        }
+    }
+
+    // g = tan(pi * cutoff / sampleRate)
+    void setCutoff(float g) {
+        a1 = 1.0 / (1.0 + g * (g + k));
+        a2 = g * a1;
+        a3 = g * a2;
+    }
+
+    float process(StateVariableFilterState& state, float v0) const {
+        float v3 = v0 - state.ic2eq;
+        float v1 = a1 * state.ic1eq + a2 * v3;
+        float v2 = state.ic2eq + a2 * state.ic1eq + a3 * v3;
+        state.ic1eq = 2.0f * v1 - state.ic1eq;
+        state.ic2eq = 2.0f * v2 - state.ic2eq;
+        return m0 * v0 + m1 * v1 + m2 * v2;
+    }
+};
+
+#endif /* StateVariableFilter_hpp */
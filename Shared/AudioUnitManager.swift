@@ -101,11 +101,13 @@ public class AudioUnitManager {
     private var parameterObserverToken: AUParameterObserverToken!
 
     // The AudioComponentDescription that matches the BiquadFilterExtension Info.plist.
+    // The extension registers as both an effect and a music effect; this app uses the
+    // music effect so it can send MIDI.
     private var componentDescription: AudioComponentDescription = {
 
         // Ensure that AudioUnit type, subtype, and manufacturer match the extension's Info.plist values.
         var componentDescription = AudioComponentDescription()
-        componentDescription.componentType = kAudioUnitType_Effect
+        componentDescription.componentType = kAudioUnitType_MusicEffect
         componentDescription.componentSubType = "bqFl".osType()! // 0x666c7472 /*'fltr'*/
         componentDescription.componentManufacturer = 0x44656d6f /*'Demo'*/
         componentDescription.componentFlags = 0
@@ -114,7 +116,7 @@ public class AudioUnitManager {
         return componentDescription
     }()
 
-    private let componentName = "Demo: BiquadFilter"
+    private let componentName = "Demo: BiquadFilter (MIDI)"
 
     public init() {
 
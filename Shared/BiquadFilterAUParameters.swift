@@ -16,11 +16,27 @@ public let CompactFilterTypes: [String] = [
 	"PeakingEQ",
 ]
 
+public let FilterTopologies: [String] = [
+	"Biquad",
+	"StateVariable",
+]
+
+public let FilterPrecisions: [String] = [
+	"Automatic",
+	"Single",
+	"ErrorFeedback",
+	"Double",
+]
+
 /// Manages the BiquadFilter object's cutoff and resonance parameters.
 class BiquadFilterAUParameters {
 
     private enum BiquadFilterParam: AUParameterAddress {
-        case cutoff, resonance, filterType
+        case cutoff, resonance, filterType, topology
+        case autoFilter, autoFilterAttack, autoFilterRelease, autoFilterDepth, autoFilterSidechain
+        case controlInterval
+        case keyTracking, pitchBendRange, controlSmoothing
+        case precision
     }
 
     /// The parameter to control the cutoff frequency (12 Hz - 20 kHz).
@@ -84,17 +100,237 @@ class BiquadFilterAUParameters {
   return parameter
 }()
 
+	/// The filter structure. The state-variable form tolerates fast cutoff modulation.
+	var topologyParam: AUParameter = {
+		let parameter =
+			AUParameterTree.createParameter(withIdentifier: "topology",
+											name: "Topology",
+											address: BiquadFilterParam.topology.rawValue,
+											min: 0,
+											max: AUValue(FilterTopologies.count - 1),
+											unit: AudioUnitParameterUnit.indexed,
+											unitName: nil,
+											flags: [.flag_IsReadable,
+													.flag_IsWritable],
+											valueStrings: FilterTopologies,
+											dependentParameters: nil)
+		// Set the default value.
+		parameter.value = Float(PARAM_ITEM_FILTER_TOPOLOGY.BIQUAD.rawValue)
+
+		return parameter
+	}()
+
+	/// Lets the envelope follower move the cutoff.
+	var autoFilterParam: AUParameter = {
+		let parameter =
+			AUParameterTree.createParameter(withIdentifier: "autoFilter",
+											name: "Auto Filter",
+											address: BiquadFilterParam.autoFilter.rawValue,
+											min: 0,
+											max: 1,
+											unit: .boolean,
+											unitName: nil,
+											flags: [.flag_IsReadable,
+													.flag_IsWritable],
+											valueStrings: nil,
+											dependentParameters: nil)
+		parameter.value = 0
+		return parameter
+	}()
+
+	/// The envelope follower's attack time (0.01 - 5000 ms).
+	var autoFilterAttackParam: AUParameter = {
+		let parameter =
+			AUParameterTree.createParameter(withIdentifier: "autoFilterAttack",
+											name: "Attack",
+											address: BiquadFilterParam.autoFilterAttack.rawValue,
+											min: 0.01,
+											max: 5000,
+											unit: .milliseconds,
+											unitName: nil,
+											flags: [.flag_IsReadable,
+													.flag_IsWritable,
+													.flag_DisplayLogarithmic],
+											valueStrings: nil,
+											dependentParameters: nil)
+		parameter.value = 10
+		return parameter
+	}()
+
+	/// The envelope follower's release time (0.01 - 5000 ms).
+	var autoFilterReleaseParam: AUParameter = {
+		let parameter =
+			AUParameterTree.createParameter(withIdentifier: "autoFilterRelease",
+											name: "Release",
+											address: BiquadFilterParam.autoFilterRelease.rawValue,
+											min: 0.01,
+											max: 5000,
+											unit: .milliseconds,
+											unitName: nil,
+											flags: [.flag_IsReadable,
+													.flag_IsWritable,
+													.flag_DisplayLogarithmic],
+											valueStrings: nil,
+											dependentParameters: nil)
+		parameter.value = 150
+		return parameter
+	}()
+
+	/// How far a full-scale envelope moves the cutoff (+/-8 octaves).
+	var autoFilterDepthParam: AUParameter = {
+		let parameter =
+			AUParameterTree.createParameter(withIdentifier: "autoFilterDepth",
+											name: "Depth",
+											address: BiquadFilterParam.autoFilterDepth.rawValue,
+											min: -8,
+											max: 8,
+											unit: .octaves,
+											unitName: nil,
+											flags: [.flag_IsReadable,
+													.flag_IsWritable],
+											valueStrings: nil,
+											dependentParameters: nil)
+		parameter.value = 4
+		return parameter
+	}()
+
+	/// Drives the envelope follower from the sidechain bus instead of the main input.
+	var autoFilterSidechainParam: AUParameter = {
+		let parameter =
+			AUParameterTree.createParameter(withIdentifier: "autoFilterSidechain",
+											name: "Sidechain",
+											address: BiquadFilterParam.autoFilterSidechain.rawValue,
+											min: 0,
+											max: 1,
+											unit: .boolean,
+											unitName: nil,
+											flags: [.flag_IsReadable,
+													.flag_IsWritable],
+											valueStrings: nil,
+											dependentParameters: nil)
+		parameter.value = 0
+		return parameter
+	}()
+
+	/// How often, in samples, internal modulation updates the filter (1 - 4096).
+	var controlIntervalParam: AUParameter = {
+		let parameter =
+			AUParameterTree.createParameter(withIdentifier: "controlInterval",
+											name: "Control Interval",
+											address: BiquadFilterParam.controlInterval.rawValue,
+											min: 1,
+											max: 4096,
+											unit: .sampleFrames,
+											unitName: nil,
+											flags: [.flag_IsReadable,
+													.flag_IsWritable],
+											valueStrings: nil,
+											dependentParameters: nil)
+		parameter.value = 32
+		return parameter
+	}()
+
+	/// How far MIDI notes move the cutoff (0 - 100 % of their pitch, around middle C).
+	var keyTrackingParam: AUParameter = {
+		let parameter =
+			AUParameterTree.createParameter(withIdentifier: "keyTracking",
+											name: "Key Tracking",
+											address: BiquadFilterParam.keyTracking.rawValue,
+											min: 0,
+											max: 100,
+											unit: .percent,
+											unitName: nil,
+											flags: [.flag_IsReadable,
+													.flag_IsWritable],
+											valueStrings: nil,
+											dependentParameters: nil)
+		parameter.value = 0
+		return parameter
+	}()
+
+	/// How far a full MIDI pitch bend moves the cutoff (0 - 48 semitones).
+	var pitchBendRangeParam: AUParameter = {
+		let parameter =
+			AUParameterTree.createParameter(withIdentifier: "pitchBendRange",
+											name: "Bend Range",
+											address: BiquadFilterParam.pitchBendRange.rawValue,
+											min: 0,
+											max: 48,
+											unit: .relativeSemiTones,
+											unitName: nil,
+											flags: [.flag_IsReadable,
+													.flag_IsWritable],
+											valueStrings: nil,
+											dependentParameters: nil)
+		parameter.value = 12
+		return parameter
+	}()
+
+	/// The glide time constant for changes that arrive over MIDI (0 - 1000 ms).
+	var controlSmoothingParam: AUParameter = {
+		let parameter =
+			AUParameterTree.createParameter(withIdentifier: "controlSmoothing",
+											name: "Smoothing",
+											address: BiquadFilterParam.controlSmoothing.rawValue,
+											min: 0,
+											max: 1000,
+											unit: .milliseconds,
+											unitName: nil,
+											flags: [.flag_IsReadable,
+													.flag_IsWritable],
+											valueStrings: nil,
+											dependentParameters: nil)
+		parameter.value = 20
+		return parameter
+	}()
+
+	/// How the biquad topology keeps its accuracy. Automatic moves to error feedback at low cutoffs.
+	var precisionParam: AUParameter = {
+		let parameter =
+			AUParameterTree.createParameter(withIdentifier: "precision",
+											name: "Precision",
+											address: BiquadFilterParam.precision.rawValue,
+											min: 0,
+											max: AUValue(FilterPrecisions.count - 1),
+											unit: AudioUnitParameterUnit.indexed,
+											unitName: nil,
+											flags: [.flag_IsReadable,
+													.flag_IsWritable],
+											valueStrings: FilterPrecisions,
+											dependentParameters: nil)
+		parameter.value = Float(PARAM_ITEM_FILTER_PRECISION.AUTOMATIC.rawValue)
+		return parameter
+	}()
+
     let parameterTree: AUParameterTree
 
+    // Main thread only; see publishValues(movedBy:kernelAdapter:).
+    private var publishingKernelValues = false
+
     init(kernelAdapter: FilterDSPKernelAdapter) {
 
         // Create the audio unit's tree of parameters.
         parameterTree = AUParameterTree.createTree(withChildren: [cutoffParam,
                                                                   resonanceParam,
-																  filterTypeParam])
+																  filterTypeParam,
+																  topologyParam,
+																  autoFilterParam,
+																  autoFilterAttackParam,
+																  autoFilterReleaseParam,
+																  autoFilterDepthParam,
+																  autoFilterSidechainParam,
+																  controlIntervalParam,
+																  keyTrackingParam,
+																  pitchBendRangeParam,
+																  controlSmoothingParam,
+																  precisionParam])
 
         // A closure for observing all externally generated parameter value changes.
-        parameterTree.implementorValueObserver = { param, value in
+        parameterTree.implementorValueObserver = { [unowned self] param, value in
+            // The kernel already has values being published from it, and may have moved on since.
+            if Thread.isMainThread && self.publishingKernelValues {
+                return
+            }
             kernelAdapter.setParameter(param, value: value)
         }
 
@@ -110,6 +346,15 @@ class BiquadFilterAUParameters {
                 return String(format: "%.f", value ?? param.value)
             case BiquadFilterParam.resonance.rawValue:
                 return String(format: "%.2f", value ?? param.value)
+            case BiquadFilterParam.autoFilterAttack.rawValue,
+                 BiquadFilterParam.autoFilterRelease.rawValue,
+                 BiquadFilterParam.autoFilterDepth.rawValue:
+                return String(format: "%.1f", value ?? param.value)
+            case BiquadFilterParam.controlInterval.rawValue,
+                 BiquadFilterParam.keyTracking.rawValue,
+                 BiquadFilterParam.pitchBendRange.rawValue,
+                 BiquadFilterParam.controlSmoothing.rawValue:
+                return String(format: "%.f", value ?? param.value)
             default:
                 return "?"
             }
@@ -120,4 +365,16 @@ class BiquadFilterAUParameters {
         cutoffParam.value = cutoff
         resonanceParam.value = resonance
     }
+
+    /// Sets the tree to the kernel's values for the parameters MIDI controllers moved, so the
+    /// host, the views and saved state see them. `addresses` has one bit per address. Main thread.
+    func publishValues(movedBy addresses: UInt32, kernelAdapter: FilterDSPKernelAdapter) {
+        guard addresses != 0 else { return }
+        publishingKernelValues = true
+        for param in parameterTree.allParameters
+            where param.address < 32 && addresses & (UInt32(1) << UInt32(param.address)) != 0 {
+            param.setValue(kernelAdapter.value(for: param), originator: nil)
+        }
+        publishingKernelValues = false
+    }
 }
@@ -157,8 +157,50 @@ public class BiquadFilterViewController: AUViewController {
 
         // Sync the UI with the parameter state.
         updateUI()
+
+        // Otherwise viewDidAppear starts it.
+        if view.window != nil {
+            startMetering()
+        }
+    }
+
+    // MARK: Metering
+
+    // The tap only runs while the view is on screen.
+    private func startMetering() {
+        guard let audioUnit = audioUnit, !needsConnection else { return }
+
+        audioUnit.spectrumAnalyzer.start { [weak self] snapshot in
+            self?.responseView.spectrum = snapshot
+        }
+    }
+
+    private func stopMetering() {
+        audioUnit?.spectrumAnalyzer.stop()
     }
 
+    #if os(macOS)
+    public override func viewDidAppear() {
+        super.viewDidAppear()
+        startMetering()
+    }
+
+    public override func viewDidDisappear() {
+        super.viewDidDisappear()
+        stopMetering()
+    }
+    #else
+    public override func viewDidAppear(_ animated: Bool) {
+        super.viewDidAppear(animated)
+        startMetering()
+    }
+
+    public override func viewDidDisappear(_ animated: Bool) {
+        super.viewDidDisappear(animated)
+        stopMetering()
+    }
+    #endif
+
     private func updateUI() {
         // Set the latest values on the graph view.
 //        filterView.frequency = cutoffParameter.value
@@ -179,9 +221,16 @@ public class BiquadFilterViewController: AUViewController {
 		frequencySlider.floatValue = cutoffValueTransformer.rawToUI(cutoffParameter.value)
 		resonanceSlider.floatValue = resonanceParameter.value
 
-//		Update Coefficients here
+		// Compute the curve off the main thread; drags coalesce to the newest position.
 		if let au = audioUnit {
-			responseView.coefficients = au.coefficients()
+			let key = ResponseCurveKey(cutoff: cutoffParameter.value,
+									   resonance: resonanceParameter.value,
+									   filterType: Int(filterTypeParameter.value),
+									   sampleRate: au.sampleRate,
+									   zeroPhase: au.zeroPhase)
+			au.responseCurveWorker.request(key) { [weak self] curve in
+				self?.responseView.display(curve)
+			}
 		}
 		
 //		guard let item = sender.selectedItem else { return }
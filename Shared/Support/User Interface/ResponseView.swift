@@ -16,6 +16,7 @@ class ResponseView: NSView {
 	static let resonanceMax = Float(25.0)
 	static let dbMin 		= Float(-20.0)
 	static let dbMax 		= Float(30.0)	// actually 25 -> 28db, roughly
+	static let levelMin		= Float(-100.0)	// dBFS, bottom of the spectrum overlay
 
 	/*
 		f = f0 * 2^^k * x  where 0 <= x <= 1
@@ -39,6 +40,24 @@ class ResponseView: NSView {
 	}
 	
 	var coefficients: BiquadCoefficientsPOD {
+		didSet {
+			magnitudes = nil
+			needsDisplay = true
+		}
+	}
+	
+	// Precomputed response for `coefficients`; computed in draw when nil.
+	private var magnitudes: [Float]?
+	
+	func display(_ curve: ResponseCurve) {
+		coefficients = curve.coefficients
+		if curve.magnitudes.count == mrc.sampleCount {
+			magnitudes = curve.magnitudes
+		}
+	}
+	
+	// Measured pre/post spectra from the metering tap, drawn behind the response.
+	var spectrum: SpectrumAnalyzer.Snapshot? {
 		didSet {
 			needsDisplay = true
 		}
@@ -51,14 +70,18 @@ class ResponseView: NSView {
 		NSColor.lightGray.setFill()
 		rpath.fill()
 		
-		let responseVals = mrc.response(for: coefficients)
+		if let spectrum = spectrum {
+			drawSpectrum(spectrum.inputSpectrum, spectrum: spectrum, color: NSColor.darkGray)
+			drawSpectrum(spectrum.outputSpectrum, spectrum: spectrum, color: NSColor.white)
+		}
+		
+		let responseVals = magnitudes ?? mrc.response(for: coefficients)
 		let rampVals = mrc.ramp
 		
 		var points = [NSPoint]()
 		for (ramp, resp) in zip(rampVals, responseVals) {
 			let pt = pointFromNorm(ramp, resonance: resp)
 			points.append(pt)
-			print("\(ramp) \(resp) -- \(pt)")
 		}
 		
 		let linePath = NSBezierPath()
@@ -70,6 +93,34 @@ class ResponseView: NSView {
 		linePath.stroke()
     }
     
+	// The response curve's x axis runs linearly from 0 to Nyquist.
+	func drawSpectrum(_ levels: [Float], spectrum: SpectrumAnalyzer.Snapshot, color: NSColor)
+	{
+		guard levels.count > 1, spectrum.sampleRate > 0 else { return }
+		
+		let nyquist = spectrum.sampleRate / 2.0
+		let path = NSBezierPath()
+		for (bin, level) in levels.enumerated() {
+			let norm = Float(Double(bin) * spectrum.binWidth / nyquist)
+			let pt = NSPoint(x: horizontalFromNorm(norm), y: verticalFromLevel(level))
+			if bin == 0 {
+				path.move(to: pt)
+			} else {
+				path.line(to: pt)
+			}
+		}
+		color.setStroke()
+		path.stroke()
+	}
+	
+	// Maps levelMin...0 dBFS onto the full height of the view.
+	func verticalFromLevel(_ db: Float) -> CGFloat
+	{
+		let h = self.frame.height
+		let clamped = max(ResponseView.levelMin, min(db, 0))
+		return h * CGFloat(1.0 - clamped / ResponseView.levelMin)
+	}
+	
 	func verticalFromResonance(_ db: Float) -> CGFloat
 	{
 		let h = self.frame.height
@@ -0,0 +1,160 @@
+/*
+  main.cpp
+  MIDIScheduleCheck
+
+  Renders short scenarios through FilterDSPKernel::processWithEvents with
+  pitch bends landing partway through 64-frame render calls, and checks each
+  against a reference run whose calls are split so that every bend arrives
+  at the start of one. The kernel is meant to apply a bend at its frame, so
+  the two have to match; a bend applied late, never, or held up behind
+  another shows up as a difference. Exits non-zero if any scenario fails.
+
+  There's no project for it; from the repository root:
+
+    c++ -std=gnu++14 -O2 -pthread -Wno-deprecated \
+        -I Tools/RenderSessionReplay/Compat -I Shared/AudioUnit/Support \
+        -x c++ Tools/MIDIScheduleCheck/main.cpp \
+        -x c++ Shared/AudioUnit/Support/DSPKernel.mm \
+        -o midi-schedule-check
+
+  On macOS, leave out the Compat include and add -framework AudioToolbox.
+*/
+
+#import <algorithm>
+#import <cmath>
+#import <cstdio>
+#import <vector>
+
+#import "FilterDSPKernel.hpp"
+
+namespace {
+
+const AUAudioFrameCount framesPerCall = 64;
+const AUAudioFrameCount totalFrames = 400 * framesPerCall;
+
+struct Bend {
+    AUEventSampleTime sampleTime;
+    int value;  // 0...16383, 8192 is centre
+};
+
+struct Scenario {
+    const char* name;
+    bool autoFilter;
+    float controlSmoothing;
+    std::vector<Bend> bends;
+};
+
+// Channel 0's output. splitAtBends starts a new render call at every bend.
+std::vector<float> render(const Scenario& scenario, const std::vector<Bend>& bends, bool splitAtBends) {
+    FilterDSPKernel kernel;
+    kernel.allocateChannelStates(1);
+    kernel.setMaximumFramesToRender(framesPerCall);
+    kernel.init(1, 48000.0);
+    kernel.setParameter(FilterParamCutoff, 1000.0f);
+    kernel.setParameter(FilterParamResonance, 0.7f);
+    kernel.setParameter(FilterParamType, PARAM_ITEM_FILTER_TYPE_LOWPASS);
+    kernel.setParameter(FilterParamAutoFilter, scenario.autoFilter ? 1.0f : 0.0f);
+    kernel.setParameter(FilterParamControlInterval, 32.0f);
+    kernel.setParameter(FilterParamPitchBendRange, 12.0f);
+    kernel.setParameter(FilterParamControlSmoothing, scenario.controlSmoothing);
+    kernel.reset();
+
+    std::vector<float> samples(framesPerCall);
+    AudioBufferList bufferList;
+    bufferList.mNumberBuffers = 1;
+    bufferList.mBuffers[0].mNumberChannels = 1;
+    bufferList.mBuffers[0].mDataByteSize = UInt32(framesPerCall * sizeof(float));
+    bufferList.mBuffers[0].mData = samples.data();
+
+    std::vector<float> output;
+    output.reserve(totalFrames);
+    std::vector<AURenderEvent> events;
+    uint32_t seed = 0x9E3779B9u;
+    for (AUAudioFrameCount start = 0; start < totalFrames;) {
+        AUAudioFrameCount frameCount = framesPerCall - start % framesPerCall;
+        if (splitAtBends) {
+            for (const Bend& bend : bends) {
+                if (bend.sampleTime > AUEventSampleTime(start)) {
+                    frameCount = std::min(frameCount, AUAudioFrameCount(bend.sampleTime - start));
+                }
+            }
+        }
+        for (AUAudioFrameCount frame = 0; frame < frameCount; ++frame) {
+            float& sample = samples[frame];
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            sample = 0.25f * (float(int32_t(seed)) / 2147483648.0f);
+        }
+
+        AudioTimeStamp timestamp = {};
+        timestamp.mSampleTime = double(start);
+
+        events.clear();
+        for (const Bend& bend : bends) {
+            if (bend.sampleTime < AUEventSampleTime(start) || bend.sampleTime >= AUEventSampleTime(start + frameCount)) {
+                continue;
+            }
+            AURenderEvent event = {};
+            event.MIDI.eventSampleTime = bend.sampleTime;
+            event.MIDI.eventType = AURenderEventMIDI;
+            event.MIDI.length = 3;
+            event.MIDI.data[0] = 0xE0;
+            event.MIDI.data[1] = uint8_t(bend.value & 0x7F);
+            event.MIDI.data[2] = uint8_t(bend.value >> 7);
+            events.push_back(event);
+        }
+        for (size_t i = 0; i + 1 < events.size(); ++i) {
+            events[i].head.next = &events[i + 1];
+        }
+
+        bufferList.mBuffers[0].mDataByteSize = UInt32(frameCount * sizeof(float));
+        kernel.setBuffers(&bufferList, &bufferList);
+        kernel.processWithEvents(&timestamp, frameCount, events.empty() ? nullptr : events.data(), nullptr);
+        output.insert(output.end(), samples.begin(), samples.begin() + frameCount);
+        start += frameCount;
+    }
+    return output;
+}
+
+double largestDifference(const std::vector<float>& a, const std::vector<float>& b) {
+    double largest = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        largest = std::max(largest, double(std::fabs(a[i] - b[i])));
+    }
+    return largest;
+}
+
+} // namespace
+
+int main() {
+    const int up = 16383;
+    const int down = 0;
+    // Control periods are 32 frames, so a bend at frame 40 of a call lands in its last.
+    const std::vector<Scenario> scenarios = {
+        // No periods: the segment is cut where the bend lands.
+        { "static, bend mid-call", false, 0.0f, { { 40, up } } },
+        { "auto filter, bend in the last period", true, 20.0f, { { 40, up } } },
+        { "auto filter, bend then another", true, 20.0f, { { 40, up }, { 64, down } } },
+        // The first bend starts a glide, so the next arrive during periodic rendering.
+        { "gliding, bend in the last period", false, 20.0f, { { 0, up }, { 104, down } } },
+        { "gliding, bend then another", false, 20.0f, { { 0, up }, { 104, down }, { 128, up } } },
+    };
+
+    int failures = 0;
+    for (const Scenario& scenario : scenarios) {
+        std::vector<float> output = render(scenario, scenario.bends, false);
+        std::vector<float> reference = render(scenario, scenario.bends, true);
+        std::vector<float> unbent = render(scenario, {}, false);
+
+        double difference = largestDifference(output, reference);
+        double bendEffect = largestDifference(reference, unbent);
+        bool passed = difference <= 1.0e-6 && bendEffect > 1.0e-3;
+        std::printf("%-40s %s (difference %.3g, bends move the output by %.3g)\n",
+                    scenario.name, passed ? "ok" : "FAILED", difference, bendEffect);
+        if (!passed) {
+            ++failures;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
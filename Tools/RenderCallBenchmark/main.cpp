@@ -0,0 +1,195 @@
+/*
+  main.cpp
+  RenderCallBenchmark
+
+  Times the fixed cost of one render call at small buffer sizes. Each call
+  does what FilterDSPKernelAdapter's render block does once the host has
+  supplied input: reset the input buffer list from its prepared copy, point
+  null output buffers at the input, hand the buffers to the kernel, meter,
+  and process. Only the host pull is missing. With most of a 1-64 frame
+  call being overhead, this is the number to watch when changing the
+  render path.
+
+  There's no project for it; from the repository root:
+
+    c++ -std=gnu++14 -O2 -pthread -Wno-deprecated \
+        -I Tools/RenderSessionReplay/Compat -I Shared/AudioUnit/Support \
+        -x c++ Tools/RenderCallBenchmark/main.cpp \
+        -x c++ Shared/AudioUnit/Support/DSPKernel.mm \
+        -o render-call-benchmark
+
+  On macOS, leave out the Compat include and add -framework AudioToolbox.
+*/
+
+#import <algorithm>
+#import <chrono>
+#import <cstdio>
+#import <cstdlib>
+#import <cstring>
+#import <memory>
+#import <string>
+#import <vector>
+
+#import "FilterDSPKernel.hpp"
+
+namespace {
+
+struct Options {
+    int channels = 2;
+    std::vector<AUAudioFrameCount> frameCounts { 1, 16, 32, 64 };
+    long samplesPerRun = 16000000;
+    int runs = 3;
+    int variant = -1;
+};
+
+void printUsage() {
+    std::fprintf(stderr,
+        "usage: render-call-benchmark [options]\n"
+        "  --channels N      channels to filter (default 2)\n"
+        "  --frames LIST     comma-separated frames per call (default 1,16,32,64)\n"
+        "  --samples N       frames rendered per run at each size (default 16000000)\n"
+        "  --runs N          report the best of N runs (default 3)\n"
+        "  --variant NAME    force a kernel variant: scalar, sse2, avx2, avx512, neon\n");
+}
+
+bool parseFrameCounts(const char* list, std::vector<AUAudioFrameCount>& frameCounts) {
+    frameCounts.clear();
+    for (const char* p = list; *p != '\0';) {
+        char* end = nullptr;
+        long frames = std::strtol(p, &end, 10);
+        if (end == p || frames < 1 || frames > 4096) {
+            return false;
+        }
+        frameCounts.push_back(AUAudioFrameCount(frames));
+        p = *end == ',' ? end + 1 : end;
+    }
+    return !frameCounts.empty();
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--channels" && hasValue) {
+            options.channels = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (argument == "--frames" && hasValue) {
+            if (!parseFrameCounts(argv[++i], options.frameCounts)) {
+                return false;
+            }
+        }
+        else if (argument == "--samples" && hasValue) {
+            options.samplesPerRun = std::max(1L, std::atol(argv[++i]));
+        }
+        else if (argument == "--runs" && hasValue) {
+            options.runs = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (argument == "--variant" && hasValue) {
+            options.variant = kernelVariantForName(argv[++i]);
+            if (options.variant < 0 || !kernelVariantSupported(options.variant)) {
+                std::fprintf(stderr, "%s isn't supported on this machine\n", argv[i]);
+                return false;
+            }
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// An AudioBufferList sized for channelCount buffers.
+struct BenchmarkBufferList {
+    explicit BenchmarkBufferList(int channelCount)
+        : bytes(offsetof(AudioBufferList, mBuffers) + size_t(channelCount) * sizeof(AudioBuffer)),
+          memory(new uint8_t[bytes]()) {
+        list = reinterpret_cast<AudioBufferList*>(memory.get());
+        list->mNumberBuffers = UInt32(channelCount);
+    }
+
+    size_t bytes;
+    std::unique_ptr<uint8_t[]> memory;
+    AudioBufferList* list;
+};
+
+double nanosecondsPerCall(const Options& options, AUAudioFrameCount frameCount) {
+    const int channelCount = options.channels;
+
+    FilterDSPKernel kernel;
+    kernel.allocateChannelStates(channelCount);
+    kernel.allocateMeteringTap(channelCount, frameCount);
+    kernel.setMaximumFramesToRender(frameCount);
+    kernel.setKernelVariantOverride(options.variant);
+    kernel.init(channelCount, 48000.0);
+    kernel.setParameter(FilterParamCutoff, 1000.0f);
+    kernel.setParameter(FilterParamResonance, 0.7f);
+    kernel.setParameter(FilterParamType, PARAM_ITEM_FILTER_TYPE_LOWPASS);
+    kernel.reset();
+
+    // The input bus's storage and its prepared list, as allocateRenderResources leaves them.
+    std::vector<float> storage(size_t(channelCount) * frameCount, 0.0f);
+    BenchmarkBufferList prepared(channelCount);
+    for (int channel = 0; channel < channelCount; ++channel) {
+        prepared.list->mBuffers[channel].mNumberChannels = 1;
+        prepared.list->mBuffers[channel].mDataByteSize = UInt32(frameCount * sizeof(float));
+        prepared.list->mBuffers[channel].mData = &storage[size_t(channel) * frameCount];
+    }
+    BenchmarkBufferList input(channelCount);
+    // Hosts that render in place pass null output buffers.
+    BenchmarkBufferList output(channelCount);
+
+    long calls = std::max(1L, options.samplesPerRun / long(frameCount));
+    double best = 0.0;
+    for (int run = 0; run < options.runs; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        for (long call = 0; call < calls; ++call) {
+            std::memcpy(input.list, prepared.list, prepared.bytes);
+            for (UInt32 i = 0; i < output.list->mNumberBuffers; ++i) {
+                output.list->mBuffers[i].mData = nullptr;
+            }
+
+            AudioBufferList* outAudioBufferList = output.list;
+            if (outAudioBufferList->mBuffers[0].mData == nullptr) {
+                for (UInt32 i = 0; i < outAudioBufferList->mNumberBuffers; ++i) {
+                    outAudioBufferList->mBuffers[i].mData = input.list->mBuffers[i].mData;
+                }
+            }
+            kernel.setBuffers(input.list, outAudioBufferList);
+            kernel.setSidechainBuffers(nullptr);
+            bool metered = kernel.meterInput(frameCount);
+            kernel.processWithoutEvents(frameCount);
+            kernel.meterOutput(frameCount, metered);
+
+            // Keep the compiler from folding calls together.
+            asm volatile("" ::: "memory");
+        }
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        double perCall = elapsed / double(calls);
+        best = run == 0 ? perCall : std::min(best, perCall);
+    }
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+
+    FilterDSPKernel probe;
+    probe.allocateChannelStates(options.channels);
+    probe.setKernelVariantOverride(options.variant);
+    probe.init(options.channels, 48000.0);
+    std::printf("%d channels, kernel variant %s, best of %d runs\n",
+                options.channels, kernelVariantName(probe.activeKernelVariant()), options.runs);
+
+    for (AUAudioFrameCount frameCount : options.frameCounts) {
+        double nanoseconds = nanosecondsPerCall(options, frameCount);
+        std::printf("%5u frames: %9.1f ns per call, %6.2f ns per frame\n",
+                    frameCount, nanoseconds, nanoseconds / double(frameCount));
+    }
+    return 0;
+}
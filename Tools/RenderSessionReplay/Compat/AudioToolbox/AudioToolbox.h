@@ -0,0 +1,115 @@
+//
+//  AudioToolbox.h
+//  BiquadFilter
+//
+//  Just enough of AudioToolbox for the kernel headers to build where there
+//  isn't one. The layouts follow Apple's so the code reads the same; only
+//  the replay tool uses this.
+//
+
+#ifndef RenderSessionReplay_AudioToolbox_h
+#define RenderSessionReplay_AudioToolbox_h
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+typedef uint8_t UInt8;
+typedef int32_t SInt32;
+typedef uint32_t UInt32;
+typedef int64_t SInt64;
+typedef uint64_t UInt64;
+typedef double Float64;
+typedef long NSInteger;
+typedef unsigned long NSUInteger;
+typedef int32_t OSStatus;
+
+// The older CF_ENUM expansion: `typedef NS_ENUM(...) {` names the integer type, then the
+// values follow in an anonymous enum. Apple's current one redeclares the enum after its
+// typedef, which GCC rejects.
+#define NS_ENUM(_type, _name) _type _name; enum : _type
+#define nil nullptr
+#define noErr 0
+
+enum {
+    kAudioUnitErr_TooManyFramesToProcess = -10874,
+    kAudioUnitErr_NoConnection = -10876,
+};
+
+typedef uint32_t AUAudioFrameCount;
+typedef uint32_t AVAudioFrameCount;
+typedef uint32_t AVAudioChannelCount;
+typedef uint64_t AUParameterAddress;
+typedef float AUValue;
+typedef int64_t AUEventSampleTime;
+typedef OSStatus AUAudioUnitStatus;
+typedef uint32_t AudioUnitRenderActionFlags;
+
+struct AudioBuffer {
+    UInt32 mNumberChannels;
+    UInt32 mDataByteSize;
+    void* mData;
+};
+
+struct AudioBufferList {
+    UInt32 mNumberBuffers;
+    AudioBuffer mBuffers[1];
+};
+
+struct AudioTimeStamp {
+    Float64 mSampleTime;
+    UInt64 mHostTime;
+    Float64 mRateScalar;
+    UInt64 mWordClockTime;
+    UInt32 mFlags;
+    UInt32 mReserved;
+};
+
+enum AURenderEventType : uint8_t {
+    AURenderEventParameter = 1,
+    AURenderEventParameterRamp = 2,
+    AURenderEventMIDI = 8,
+    AURenderEventMIDISysEx = 9,
+};
+
+union AURenderEvent;
+
+struct AURenderEventHeader {
+    union AURenderEvent* next;
+    AUEventSampleTime eventSampleTime;
+    AURenderEventType eventType;
+    uint8_t reserved;
+};
+
+struct AUParameterEvent {
+    union AURenderEvent* next;
+    AUEventSampleTime eventSampleTime;
+    AURenderEventType eventType;
+    uint8_t reserved[3];
+    AUAudioFrameCount rampDurationSampleFrames;
+    AUParameterAddress parameterAddress;
+    AUValue value;
+};
+
+struct AUMIDIEvent {
+    union AURenderEvent* next;
+    AUEventSampleTime eventSampleTime;
+    AURenderEventType eventType;
+    uint8_t reserved;
+    uint16_t length;
+    uint8_t cable;
+    uint8_t data[3];
+};
+
+union AURenderEvent {
+    AURenderEventHeader head;
+    AUParameterEvent parameter;
+    AUMIDIEvent MIDI;
+};
+
+// A block on Apple platforms; the replay never passes one.
+typedef OSStatus (*AUMIDIOutputEventBlock)(AUEventSampleTime eventSampleTime, uint8_t cable,
+                                          NSInteger length, const uint8_t* midiBytes);
+
+#endif /* RenderSessionReplay_AudioToolbox_h */
@@ -0,0 +1,11 @@
+//
+//  OSAtomic.h
+//  BiquadFilter
+//
+//  ParameterRamper.hpp imports this but uses std::atomic; nothing else is needed.
+//
+
+#ifndef RenderSessionReplay_OSAtomic_h
+#define RenderSessionReplay_OSAtomic_h
+
+#endif /* RenderSessionReplay_OSAtomic_h */
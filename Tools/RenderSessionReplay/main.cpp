@@ -0,0 +1,463 @@
+/*
+  main.cpp
+  RenderSessionReplay
+
+  Plays a session recorded by RenderSessionRecorder back through
+  FilterDSPKernel, outside any host, and times every callback. Writing the
+  output and comparing it with an earlier build's shows whether a change
+  altered what the filter does, not just how fast.
+
+  There's no project for it; from the repository root:
+
+    c++ -std=gnu++14 -O2 -pthread -Wno-deprecated \
+        -I Tools/RenderSessionReplay/Compat -I Shared/AudioUnit/Support \
+        -x c++ Tools/RenderSessionReplay/main.cpp \
+        -x c++ Shared/AudioUnit/Support/DSPKernel.mm \
+        -o render-session-replay
+
+  On macOS, leave out the Compat include and add -framework AudioToolbox.
+*/
+
+#import <algorithm>
+#import <chrono>
+#import <cmath>
+#import <cstdio>
+#import <cstdlib>
+#import <cstring>
+#import <memory>
+#import <string>
+#import <vector>
+
+#import "FilterDSPKernel.hpp"
+#import "RenderSessionRecorder.hpp"
+
+namespace {
+
+struct Options {
+    const char* sessionPath = nullptr;
+    const char* outputPath = nullptr;
+    const char* comparePath = nullptr;
+    double tolerance = 0.0;
+    int passes = 1;
+    int variant = -1;
+    int workers = 0;
+};
+
+void printUsage() {
+    std::fprintf(stderr,
+        "usage: render-session-replay SESSION [options]\n"
+        "  --passes N        replay N times; timings cover every pass (default 1)\n"
+        "  --variant NAME    force a kernel variant: scalar, sse2, avx2, avx512, neon\n"
+        "  --workers N       render with N worker threads (default 0)\n"
+        "  --output FILE     write the first pass's output as interleaved float32\n"
+        "  --compare FILE    compare the first pass's output with a file written by --output\n"
+        "  --tolerance X     largest difference --compare accepts (default 0, bit exact)\n");
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--passes" && hasValue) {
+            options.passes = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (argument == "--variant" && hasValue) {
+            options.variant = kernelVariantForName(argv[++i]);
+            if (options.variant < 0 || !kernelVariantSupported(options.variant)) {
+                std::fprintf(stderr, "%s isn't supported on this machine\n", argv[i]);
+                return false;
+            }
+        }
+        else if (argument == "--workers" && hasValue) {
+            options.workers = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (argument == "--output" && hasValue) {
+            options.outputPath = argv[++i];
+        }
+        else if (argument == "--compare" && hasValue) {
+            options.comparePath = argv[++i];
+        }
+        else if (argument == "--tolerance" && hasValue) {
+            options.tolerance = std::atof(argv[++i]);
+        }
+        else if (argument[0] != '-' && options.sessionPath == nullptr) {
+            options.sessionPath = argv[i];
+        }
+        else {
+            return false;
+        }
+    }
+    return options.sessionPath != nullptr;
+}
+
+/*
+ AudioBufferList ends in a one-element array; this sizes it for the
+ session's channels and points each buffer at storage of its own.
+ */
+class ReplayBufferList {
+public:
+    ReplayBufferList(int channelCount, AUAudioFrameCount maximumFrames)
+        : storage(size_t(channelCount), std::vector<float>(maximumFrames, 0.0f)) {
+        size_t bytes = offsetof(AudioBufferList, mBuffers) + size_t(std::max(channelCount, 1)) * sizeof(AudioBuffer);
+        memory.reset(new uint8_t[bytes]);
+        list = reinterpret_cast<AudioBufferList*>(memory.get());
+        list->mNumberBuffers = UInt32(channelCount);
+        for (int channel = 0; channel < channelCount; ++channel) {
+            list->mBuffers[channel].mNumberChannels = 1;
+            list->mBuffers[channel].mDataByteSize = UInt32(maximumFrames * sizeof(float));
+            list->mBuffers[channel].mData = storage[channel].data();
+        }
+    }
+
+    float* channel(int index) {
+        return storage[size_t(index)].data();
+    }
+
+    AudioBufferList* list;
+
+private:
+    std::vector<std::vector<float>> storage;
+    std::unique_ptr<uint8_t[]> memory;
+};
+
+// Stands in for the input of sessions recorded without audio. The same every run.
+class TestNoise {
+public:
+    explicit TestNoise(int channelCount) : seeds(size_t(channelCount)) {
+        for (size_t channel = 0; channel < seeds.size(); ++channel) {
+            seeds[channel] = 0x9E3779B9u * uint32_t(channel + 1);
+        }
+    }
+
+    void fill(int channel, float* samples, AUAudioFrameCount frameCount) {
+        uint32_t& state = seeds[size_t(channel)];
+        for (AUAudioFrameCount frame = 0; frame < frameCount; ++frame) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            // About -12 dBFS peak.
+            samples[frame] = 0.25f * (float(int32_t(state)) / 2147483648.0f);
+        }
+    }
+
+private:
+    std::vector<uint32_t> seeds;
+};
+
+struct ReplayStatistics {
+    std::vector<double> callbackNanoseconds;
+    double audioSeconds = 0.0;
+    uint64_t droppedCallbacks = 0;
+    uint64_t truncatedCallbacks = 0;
+    uint64_t comparedSamples = 0;
+    double largestDifference = 0.0;
+    int64_t firstDifferingCallback = -1;
+    bool compareFileShort = false;
+};
+
+bool readRecord(std::FILE* session, std::vector<uint8_t>& record) {
+    RenderSessionCallback callback;
+    if (std::fread(&callback, sizeof(callback), 1, session) != 1) {
+        return false;
+    }
+    if (callback.recordBytes < sizeof(callback)) {
+        std::fprintf(stderr, "corrupt record\n");
+        return false;
+    }
+    record.resize(callback.recordBytes);
+    std::memcpy(record.data(), &callback, sizeof(callback));
+    size_t payload = callback.recordBytes - sizeof(callback);
+    if (std::fread(record.data() + sizeof(callback), 1, payload, session) != payload) {
+        std::fprintf(stderr, "session ends partway through a record\n");
+        return false;
+    }
+    return true;
+}
+
+// The map, then the parameter a learn is waiting to bind, as RenderSessionRecorder writes them.
+void applyControllerMap(MIDIControllerMap& map, const std::vector<int32_t>& addresses) {
+    int controllerCount = std::min(int(addresses.size()) - 1, int(MIDIControllerMap::controllerCount));
+    for (int controller = 0; controller < controllerCount; ++controller) {
+        int32_t address = addresses[size_t(controller)];
+        map.map(controller, address < int32_t(FilterParamCount) ? address : MIDIControllerMap::unmapped);
+    }
+    int32_t learning = addresses.back();
+    if (learning == MIDIControllerMap::unmapped) {
+        map.cancelLearn();
+    }
+    else if (learning != map.learningParameter() && learning < int32_t(FilterParamCount)) {
+        map.learn(learning);
+    }
+}
+
+void replayPass(std::FILE* session, const RenderSessionFileHeader& header, const Options& options,
+                bool firstPass, std::FILE* output, std::FILE* compare, ReplayStatistics& statistics) {
+    const int channelCount = int(header.channelCount);
+    const AUAudioFrameCount maximumFrames = header.maximumFrames;
+
+    // Set up the way allocateRenderResources does, so each pass starts from the same state.
+    FilterDSPKernel kernel;
+    kernel.allocateChannelStates(channelCount);
+    kernel.setMaximumFramesToRender(maximumFrames);
+    kernel.setKernelVariantOverride(options.variant);
+    kernel.init(channelCount, header.sampleRate);
+    kernel.reset();
+    kernel.startRenderWorkers(options.workers, maximumFrames);
+    if (firstPass) {
+        std::printf("kernel variant %s, %d render workers\n",
+                    kernelVariantName(kernel.activeKernelVariant()), kernel.renderWorkerCount());
+        if (kernel.renderWorkerCount() > 0) {
+            std::printf("periods of %u channel-frames or more are shared with the workers\n",
+                        kernel.parallelRenderThreshold());
+        }
+    }
+
+    ReplayBufferList input(channelCount, maximumFrames);
+    ReplayBufferList sidechain(channelCount, maximumFrames);
+    ReplayBufferList processed(channelCount, maximumFrames);
+    TestNoise noise(channelCount);
+    std::vector<AURenderEvent> events(RenderSessionRecorder::maximumEventsPerCallback);
+    std::vector<float> interleaved(size_t(channelCount) * maximumFrames);
+    std::vector<float> expected(interleaved.size());
+    std::vector<uint8_t> record;
+    std::vector<int32_t> controllerAddresses;
+    int64_t callbackIndex = 0;
+
+    std::fseek(session, long(sizeof(RenderSessionFileHeader)), SEEK_SET);
+    while (readRecord(session, record)) {
+        RenderSessionCallback callback;
+        std::memcpy(&callback, record.data(), sizeof(callback));
+        const uint8_t* cursor = record.data() + sizeof(callback);
+        const AUAudioFrameCount frameCount = callback.frameCount;
+        if (frameCount > maximumFrames || callback.eventCount > events.size()) {
+            std::fprintf(stderr, "corrupt record\n");
+            break;
+        }
+
+        if (firstPass) {
+            statistics.droppedCallbacks += callback.droppedCallbacks;
+            if (callback.flags & RenderSessionCallbackEventsTruncated) {
+                ++statistics.truncatedCallbacks;
+            }
+        }
+
+        // Parameters from a session recorded with more of them than this build has are ignored.
+        for (uint32_t address = 0; address < callback.parameterCount; ++address) {
+            AUValue value;
+            std::memcpy(&value, cursor, sizeof(value));
+            cursor += sizeof(value);
+            if (address < FilterParamCount) {
+                kernel.setParameter(address, value);
+            }
+        }
+        if (callback.controllerCount > 0) {
+            controllerAddresses.resize(callback.controllerCount);
+            std::memcpy(controllerAddresses.data(), cursor, controllerAddresses.size() * sizeof(int32_t));
+            cursor += controllerAddresses.size() * sizeof(int32_t);
+            applyControllerMap(kernel.controllerMap, controllerAddresses);
+        }
+        kernel.setBypass(callback.flags & RenderSessionCallbackBypassed);
+
+        for (uint32_t index = 0; index < callback.eventCount; ++index) {
+            RenderSessionEvent recorded;
+            std::memcpy(&recorded, cursor, sizeof(recorded));
+            cursor += sizeof(recorded);
+
+            AURenderEvent& event = events[index];
+            std::memset(&event, 0, sizeof(event));
+            event.head.eventSampleTime = recorded.sampleTime;
+            event.head.eventType = AURenderEventType(recorded.type);
+            if (recorded.type == AURenderEventParameter || recorded.type == AURenderEventParameterRamp) {
+                event.parameter.rampDurationSampleFrames = recorded.rampFrames;
+                event.parameter.parameterAddress = recorded.address;
+                event.parameter.value = recorded.value;
+            }
+            else {
+                event.MIDI.cable = recorded.cable;
+                event.MIDI.length = recorded.length;
+                std::memcpy(event.MIDI.data, recorded.data, sizeof(event.MIDI.data));
+            }
+            event.head.next = index + 1 < callback.eventCount ? &events[index + 1] : nullptr;
+        }
+
+        for (int channel = 0; channel < channelCount; ++channel) {
+            if (channel < callback.inputChannelCount) {
+                std::memcpy(input.channel(channel), cursor, frameCount * sizeof(float));
+                cursor += frameCount * sizeof(float);
+            }
+            else {
+                noise.fill(channel, input.channel(channel), frameCount);
+            }
+        }
+        for (int channel = 0; channel < callback.sidechainChannelCount && channel < channelCount; ++channel) {
+            std::memcpy(sidechain.channel(channel), cursor, frameCount * sizeof(float));
+            cursor += frameCount * sizeof(float);
+        }
+        sidechain.list->mNumberBuffers = std::min(UInt32(callback.sidechainChannelCount), UInt32(channelCount));
+
+        AudioTimeStamp timestamp = {};
+        timestamp.mSampleTime = callback.sampleTime;
+        timestamp.mHostTime = callback.hostTime;
+
+        kernel.setBuffers(input.list, processed.list);
+        kernel.setSidechainBuffers(callback.sidechainChannelCount > 0 ? sidechain.list : nullptr);
+
+        // The same calls, in the same order, as the adapter's render block.
+        auto start = std::chrono::steady_clock::now();
+        if (callback.eventCount == 0) {
+            kernel.processWithoutEvents(frameCount);
+        }
+        else {
+            kernel.processWithEvents(&timestamp, frameCount, &events[0], nullptr);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        statistics.callbackNanoseconds.push_back(double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+        statistics.audioSeconds += double(frameCount) / header.sampleRate;
+
+        if (!firstPass || (output == nullptr && compare == nullptr)) {
+            ++callbackIndex;
+            continue;
+        }
+
+        size_t sampleCount = size_t(frameCount) * size_t(channelCount);
+        for (AUAudioFrameCount frame = 0; frame < frameCount; ++frame) {
+            for (int channel = 0; channel < channelCount; ++channel) {
+                interleaved[size_t(frame) * channelCount + channel] = processed.channel(channel)[frame];
+            }
+        }
+        if (output != nullptr) {
+            std::fwrite(interleaved.data(), sizeof(float), sampleCount, output);
+        }
+        if (compare != nullptr && !statistics.compareFileShort) {
+            if (std::fread(expected.data(), sizeof(float), sampleCount, compare) != sampleCount) {
+                statistics.compareFileShort = true;
+            }
+            else {
+                for (size_t sample = 0; sample < sampleCount; ++sample) {
+                    double difference = std::fabs(double(interleaved[sample]) - double(expected[sample]));
+                    // NaN counts as a difference.
+                    if (!(difference <= options.tolerance) && statistics.firstDifferingCallback < 0) {
+                        statistics.firstDifferingCallback = callbackIndex;
+                    }
+                    if (!(difference <= statistics.largestDifference)) {
+                        statistics.largestDifference = difference;
+                    }
+                }
+                statistics.comparedSamples += sampleCount;
+            }
+        }
+        ++callbackIndex;
+    }
+
+    kernel.stopRenderWorkers();
+}
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = size_t(fraction * double(sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+void printTimings(const ReplayStatistics& statistics, const RenderSessionFileHeader& header) {
+    std::vector<double> sorted = statistics.callbackNanoseconds;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0.0;
+    for (double nanoseconds : sorted) {
+        total += nanoseconds;
+    }
+    double mean = sorted.empty() ? 0.0 : total / double(sorted.size());
+    double budget = 1.0e9 * double(header.maximumFrames) / header.sampleRate;
+
+    std::printf("%zu callbacks, %.3f s of audio\n", sorted.size(), statistics.audioSeconds);
+    std::printf("per callback (us): mean %.2f  median %.2f  p99 %.2f  max %.2f\n",
+                mean / 1000.0, percentile(sorted, 0.5) / 1000.0,
+                percentile(sorted, 0.99) / 1000.0, (sorted.empty() ? 0.0 : sorted.back()) / 1000.0);
+    std::printf("a full %u-frame callback has %.2f us; worst used %.1f%%, overall load %.3f%%\n",
+                header.maximumFrames, budget / 1000.0,
+                sorted.empty() ? 0.0 : 100.0 * sorted.back() / budget,
+                statistics.audioSeconds > 0.0 ? 100.0 * total / (1.0e9 * statistics.audioSeconds) : 0.0);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+
+    std::FILE* session = std::fopen(options.sessionPath, "rb");
+    if (session == nullptr) {
+        std::perror(options.sessionPath);
+        return 2;
+    }
+    RenderSessionFileHeader header;
+    if (std::fread(&header, sizeof(header), 1, session) != 1
+        || std::memcmp(header.magic, kRenderSessionMagic, sizeof(header.magic)) != 0) {
+        std::fprintf(stderr, "%s isn't a render session\n", options.sessionPath);
+        return 2;
+    }
+    if (header.version != kRenderSessionVersion) {
+        std::fprintf(stderr, "%s is version %u; this build reads version %u\n",
+                     options.sessionPath, header.version, kRenderSessionVersion);
+        return 2;
+    }
+    if (header.channelCount == 0 || header.maximumFrames == 0 || !(header.sampleRate > 0.0)) {
+        std::fprintf(stderr, "%s has an invalid format\n", options.sessionPath);
+        return 2;
+    }
+    std::printf("%s: %u channels at %.0f Hz, up to %u frames per callback, %s\n",
+                options.sessionPath, header.channelCount, header.sampleRate, header.maximumFrames,
+                (header.flags & RenderSessionIncludesAudio) ? "recorded input" : "test noise input");
+
+    std::FILE* output = nullptr;
+    if (options.outputPath != nullptr && (output = std::fopen(options.outputPath, "wb")) == nullptr) {
+        std::perror(options.outputPath);
+        return 2;
+    }
+    std::FILE* compare = nullptr;
+    if (options.comparePath != nullptr && (compare = std::fopen(options.comparePath, "rb")) == nullptr) {
+        std::perror(options.comparePath);
+        return 2;
+    }
+
+    ReplayStatistics statistics;
+    for (int pass = 0; pass < options.passes; ++pass) {
+        replayPass(session, header, options, pass == 0, output, compare, statistics);
+    }
+    std::fclose(session);
+    if (output != nullptr) {
+        std::fclose(output);
+    }
+
+    printTimings(statistics, header);
+    if (statistics.droppedCallbacks > 0) {
+        std::printf("warning: %llu callbacks were dropped while recording\n",
+                    (unsigned long long)statistics.droppedCallbacks);
+    }
+    if (statistics.truncatedCallbacks > 0) {
+        std::printf("warning: %llu callbacks had more events than were recorded\n",
+                    (unsigned long long)statistics.truncatedCallbacks);
+    }
+
+    int status = 0;
+    if (compare != nullptr) {
+        bool longer = !statistics.compareFileShort && std::fgetc(compare) != EOF;
+        std::fclose(compare);
+        std::printf("compared %llu samples, largest difference %g\n",
+                    (unsigned long long)statistics.comparedSamples, statistics.largestDifference);
+        if (statistics.firstDifferingCallback >= 0) {
+            std::printf("output differs from callback %lld on\n", (long long)statistics.firstDifferingCallback);
+            status = 1;
+        }
+        if (statistics.compareFileShort || longer) {
+            std::printf("output and %s differ in length\n", options.comparePath);
+            status = 1;
+        }
+    }
+    return status;
+}